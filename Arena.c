@@ -0,0 +1,287 @@
+/*
+* File: Arena.c
+* Decription:
+* implements a bump (arena) allocator with per-size-class
+* free lists for the small records amici keeps per person
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "Arena.h"
+
+/*
+*  Blocks up to SMALL_LIMIT bytes are grouped in classes ARENA_ALIGN
+*  bytes apart; larger blocks are rounded up to a power of two.  Blocks
+*  bigger than a quarter chunk get a chunk of their own so they do not
+*  waste the tail of the current one.
+*/
+#define SMALL_LIMIT 512
+#define SMALL_CLASSES (SMALL_LIMIT / ARENA_ALIGN)
+#define NUM_CLASSES (SMALL_CLASSES + 64)
+#define LARGE_BLOCK (ARENA_CHUNK_SIZE / 4)
+
+/*
+*  struct chunk_s:
+*  A header placed in front of each chunk of memory the arena owns.
+*/
+typedef struct chunk_s {
+    struct chunk_s *next;
+    size_t size;
+} chunk;
+
+/*
+*  struct arena_s:
+*  A structure representing an arena
+*
+*  chunks lists every chunk.  Blocks are bumped out of the current
+*  chunk between pos and end.  free_lists holds, per size class, the
+*  blocks handed back by the client, linked through their first word.
+*  A shared arena holds lock while it allocates or frees.
+*/
+typedef struct arena_s {
+    chunk *chunks;
+    char *pos;
+    char *end;
+    size_t used;
+    void *free_lists[NUM_CLASSES];
+    bool shared;
+    pthread_mutex_t lock;
+} arena;
+
+
+/*
+*  static size_t size_class(size_t size, size_t *block_size):
+*
+*  @param size: A requested allocation size.
+*  @param block_size: Out parameter receiving the size actually handed out.
+*  @return: Returns the size class of the request.
+*/
+static size_t size_class(size_t size, size_t *block_size){
+
+    size_t rounded = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+    if (rounded <= SMALL_LIMIT) {
+        *block_size = rounded;
+        return rounded / ARENA_ALIGN - 1;
+    }
+
+    size_t power = SMALL_LIMIT * 2;
+    size_t class = SMALL_CLASSES;
+    while (power < rounded) {
+        power *= 2;
+        class++;
+    }
+
+    assert(class < NUM_CLASSES);
+    *block_size = power;
+    return class;
+}
+
+/*
+*  static chunk *new_chunk(Arena a, size_t size):
+*
+*  Allocates a chunk with room for size bytes and links it into the arena.
+*
+*  @param a: The arena.
+*  @param size: The usable size of the chunk.
+*  @return: Returns the new chunk.
+*/
+static chunk *new_chunk(Arena a, size_t size){
+
+    chunk *c = (chunk *)malloc(sizeof(chunk) + size);
+    assert(c != NULL);
+
+    c->size = size;
+    c->next = a->chunks;
+    a->chunks = c;
+
+    return c;
+}
+
+/*
+*  Arena arena_create:
+*  creates a new, empty arena
+*
+*  Returns an Arena.
+*/
+Arena arena_create(void){
+
+    Arena a = (Arena)malloc(sizeof(struct arena_s));
+    assert(a != NULL);
+
+    a->chunks = NULL;
+    a->pos = NULL;
+    a->end = NULL;
+    a->used = 0;
+    memset(a->free_lists, 0, sizeof(a->free_lists));
+    a->shared = false;
+    pthread_mutex_init(&a->lock, NULL);
+
+    return a;
+}
+
+/*
+*  struct arena_destroy:
+*
+*  Frees every chunk of the arena and then the arena itself.
+*
+*  @param a: The arena to be destroyed.
+*/
+void arena_destroy(Arena a){
+
+    if (a == NULL) {
+        return;
+    }
+
+    arena_reset(a);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+}
+
+/*
+*  static void *take(Arena a, size_t size):
+*
+*  Hands out a block of at least size bytes, reusing a freed block of
+*  the same class when there is one and bumping the current chunk
+*  otherwise.
+*
+*  @param a: The arena.
+*  @param size: The number of bytes needed.
+*  @return: Returns the block.
+*/
+static void *take(Arena a, size_t size){
+
+    size_t block_size;
+    size_t class = size_class(size, &block_size);
+
+    a->used += block_size;
+
+    void *block = a->free_lists[class];
+    if (block != NULL) {
+        memcpy(&a->free_lists[class], block, sizeof(void *));
+        return block;
+    }
+
+    if (block_size > LARGE_BLOCK) {
+        // a chunk of its own; the current chunk keeps being bumped
+        chunk *c = new_chunk(a, block_size);
+        return (char *)(c + 1);
+    }
+
+    if ((size_t)(a->end - a->pos) < block_size) {
+        chunk *c = new_chunk(a, ARENA_CHUNK_SIZE);
+        a->pos = (char *)(c + 1);
+        a->end = a->pos + ARENA_CHUNK_SIZE;
+    }
+
+    block = a->pos;
+    a->pos += block_size;
+
+    return block;
+}
+
+/*
+*  struct arena_alloc:
+*
+*  @param a: The arena.
+*  @param size: The number of bytes needed.
+*  @return: Returns the block.
+*/
+void *arena_alloc(Arena a, size_t size){
+
+    assert(a != NULL && size > 0);
+
+    if (!a->shared) {
+        return take(a, size);
+    }
+
+    pthread_mutex_lock(&a->lock);
+    void *block = take(a, size);
+    pthread_mutex_unlock(&a->lock);
+
+    return block;
+}
+
+/*
+*  struct arena_free:
+*
+*  Pushes a block onto the free list of its size class.
+*
+*  @param a: The arena.
+*  @param block: The block being handed back (may be NULL).
+*  @param size: The size the block was allocated with.
+*/
+void arena_free(Arena a, void *block, size_t size){
+
+    if (a == NULL || block == NULL) {
+        return;
+    }
+
+    size_t block_size;
+    size_t class = size_class(size, &block_size);
+
+    if (a->shared) {
+        pthread_mutex_lock(&a->lock);
+    }
+
+    a->used -= block_size;
+
+    memcpy(block, &a->free_lists[class], sizeof(void *));
+    a->free_lists[class] = block;
+
+    if (a->shared) {
+        pthread_mutex_unlock(&a->lock);
+    }
+}
+
+/*
+*  struct arena_reset:
+*
+*  Frees every chunk and forgets every free list, releasing all blocks
+*  without visiting them.
+*
+*  @param a: The arena.
+*/
+void arena_reset(Arena a){
+
+    if (a == NULL) {
+        return;
+    }
+
+    while (a->chunks != NULL) {
+        chunk *next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+
+    a->pos = NULL;
+    a->end = NULL;
+    a->used = 0;
+    memset(a->free_lists, 0, sizeof(a->free_lists));
+}
+
+/*
+*  struct arena_used:
+*
+*  @param a: The arena.
+*  @return: Returns the number of bytes currently handed out.
+*/
+size_t arena_used(const Arena a){
+    return a == NULL ? 0 : a->used;
+}
+
+/*
+*  struct arena_set_shared:
+*
+*  @param a: The arena.
+*  @param shared: Whether allocations and frees take the arena's lock.
+*/
+void arena_set_shared(Arena a, bool shared){
+    a->shared = shared;
+}
@@ -0,0 +1,120 @@
+/// \file Arena.h
+/// \brief A bump allocator for many small records with a shared lifetime.
+///
+/// @author Connor Patterson
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>     // size_t
+#include <stdbool.h>    // bool
+
+/// Size of each chunk the arena carves blocks out of
+#define ARENA_CHUNK_SIZE 65536
+
+/// Alignment (and size granularity) of every block handed out
+#define ARENA_ALIGN 8
+
+///
+/// General Notes on arena Operation
+///
+/// - Blocks are carved sequentially out of large chunks, so records
+///   allocated one after another sit next to each other in memory and
+///   cost no per-block bookkeeping.
+///
+/// - A block may be handed back with arena_free(); it is kept on a free
+///   list for its size class and reused by the next allocation of that
+///   class.  The client must pass the same size it allocated with.
+///
+/// - arena_reset() releases every block at once by dropping the chunks,
+///   without visiting the blocks.
+///
+/// - An arena is used by one thread at a time unless it is made shared
+///   with arena_set_shared(); arena_alloc() and arena_free() then take a
+///   lock.  arena_reset() and arena_destroy() never may run alongside
+///   anything else.
+///
+/// - Wherever a function has a precondition, and the client violates the
+///   condition, and the code detects the violation, then the function will
+///   assert failure and abort.
+///
+
+///
+/// The Arena data type is a pointer to an opaque structure.
+///
+typedef struct arena_s *Arena;
+
+///
+/// Create a new, empty arena.
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @return A newly created arena
+///
+Arena arena_create( void );
+
+///
+/// Destroy the arena and every block allocated from it.
+///
+/// @param a The arena to destroy
+///
+/// @post a is not a valid instance of arena.
+///
+void arena_destroy( Arena a );
+
+///
+/// Allocate a block of at least size bytes, aligned to ARENA_ALIGN.
+/// The contents of the block are unspecified.
+///
+/// @param a The arena
+/// @param size The number of bytes needed
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @pre a is a valid instance of arena, and size is greater than 0.
+///
+/// @return The new block
+///
+void *arena_alloc( Arena a, size_t size );
+
+///
+/// Hand a block back to the arena for reuse by later allocations of the
+/// same size class.
+///
+/// @param a The arena
+/// @param block A block from arena_alloc() on a, or NULL
+/// @param size The size that block was allocated with
+///
+/// @pre block is not used again by the client.
+///
+void arena_free( Arena a, void *block, size_t size );
+
+///
+/// Release every block of the arena at once.  The cost depends on the
+/// number of chunks, not on the number of blocks.
+///
+/// @param a The arena
+///
+/// @post every block previously allocated from a is invalid.
+///
+void arena_reset( Arena a );
+
+///
+/// @param a The arena
+///
+/// @return The number of bytes currently handed out to the client
+///
+size_t arena_used( const Arena a );
+
+///
+/// Make arena_alloc() and arena_free() safe to call from several threads
+/// at once, or stop doing so.  Arenas are not shared by default.
+///
+/// @param a The arena
+/// @param shared Whether several threads may allocate at once
+///
+/// @pre a is a valid instance of arena, and no other thread is using it.
+///
+void arena_set_shared( Arena a, bool shared );
+
+#endif // ARENA_H
@@ -0,0 +1,826 @@
+/*
+* File: ConcurrentHashADT.c
+* Decription:
+* implements a hash table that lookups read without locks while
+* writers lock one stripe of the table
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include "ConcurrentHashADT.h"
+
+/*
+*  Markers stored in place of a key.  A writer claims an empty slot by
+*  setting its key to BUSY, fills in the hash code and value, and only
+*  then stores the real key, so a lookup that sees a key also sees the
+*  rest of the slot.  A removed key becomes REMOVED, which lookups step
+*  over; slots are never emptied again, so probe chains never break
+*  under a lookup, and REMOVED slots disappear at the next rehash.
+*/
+static char busy_marker;
+static char removed_marker;
+#define BUSY ((void *)&busy_marker)
+#define REMOVED ((void *)&removed_marker)
+
+/*
+*  struct slot_s:
+*  One slot of the table
+*/
+typedef struct slot_s {
+    size_t hash;
+    void *key;
+    void *value;
+} slot;
+
+/*
+*  struct array_s:
+*  One set of slots
+*
+*  used counts the slots that are not empty, REMOVED ones included.
+*  Writers reserve a slot by raising it before claiming one, and it
+*  never passes the load threshold, so an empty slot always ends a
+*  probe chain.
+*/
+typedef struct array_s {
+    size_t capacity;
+    size_t used;
+    slot slots[];
+} array;
+
+/*
+*  struct retired_s:
+*  An array replaced by a rehash, or a pair handed to cht_retire() or a
+*  value (with a NULL key) handed to cht_retire_value(), waiting until
+*  no lookup can still be reading it.
+*/
+typedef struct retired_s {
+    struct retired_s *next;
+    uint64_t epoch;
+    array *arr;
+    void *key;
+    void *value;
+} retired;
+
+/*
+*  struct reader_s:
+*  The epoch record of one thread
+*
+*  state is 0 while the thread is outside the table, otherwise the
+*  global epoch it read on entering.  Records are shared by every
+*  table, and are handed on to a new thread when theirs exits.
+*/
+typedef struct reader_s {
+    uint64_t state;
+    int in_use;
+    struct reader_s *next;
+} reader;
+
+/*
+*  One lock per stripe, each on its own cache line so writers locking
+*  neighbouring stripes do not contend for it.
+*/
+typedef union stripe_u {
+    pthread_mutex_t lock;
+    char pad[64];
+} stripe;
+
+/*
+*  struct chtab_s:
+*  A structure representing a concurrent hash table
+*
+*  cur is the array every operation starts from.  A writer holds the
+*  stripe of its key's hash while it works, and a rehash holds every
+*  stripe, so cur only changes while no writer is in the table.
+*
+*  Retired arrays and pairs are kept on a list, under retire_lock, with
+*  the epoch they were retired in.  Each retirement advances the global
+*  epoch, so any thread that enters the table afterwards has a later
+*  epoch and can no longer reach what was retired; an entry is released
+*  once every thread still inside has a later epoch.  The list is swept
+*  when an array is retired or it has grown by CHT_RETIRE_BATCH.
+*/
+typedef struct chtab_s {
+
+    size_t (*hash)(const void *key);
+    bool (*equals)(const void *key1, const void *key2);
+    void (*print)(const void *key, const void *value);
+    void (*delete)(void *key, void *value);
+
+    array *cur;
+    size_t size;
+    size_t rehashes;
+
+    stripe stripes[CHT_STRIPES];
+
+    pthread_mutex_t retire_lock;
+    retired *retired;
+    size_t retired_count;
+    size_t sweep_at;
+
+} chtab;
+
+// the epoch records of every thread that has used a table
+static reader *readers = NULL;
+static uint64_t global_epoch = 1;
+
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+static pthread_key_t reader_key;
+
+static __thread reader *self = NULL;
+static __thread unsigned depth = 0;
+
+
+/*
+*  static void release_reader(void *r):
+*
+*  Runs as a thread exits, letting another thread take its record.
+*
+*  @param r: The thread's epoch record.
+*/
+static void release_reader(void *r){
+    __atomic_store_n(&((reader *)r)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*
+*  static void make_reader_key(void):
+*
+*  Creates the key whose destructor releases a thread's record.
+*/
+static void make_reader_key(void){
+    pthread_key_create(&reader_key, release_reader);
+}
+
+/*
+*  static reader *join(void):
+*
+*  @return: Returns the calling thread's epoch record, taking a free
+*  one or adding a new one the first time the thread asks.
+*/
+static reader *join(void){
+
+    if (self != NULL) {
+        return self;
+    }
+
+    pthread_once(&reader_once, make_reader_key);
+
+    reader *r;
+    for (r = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&r->in_use, &expected, 1, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (r == NULL) {
+        r = malloc(sizeof(reader));
+        assert(r != NULL);
+        r->state = 0;
+        r->in_use = 1;
+        r->next = __atomic_load_n(&readers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&readers, &r->next, r, false,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    pthread_setspecific(reader_key, r);
+    self = r;
+
+    return r;
+}
+
+/*
+*  static void enter(void):
+*
+*  Marks the calling thread as inside a table until the matching
+*  leave().  Calls nest.
+*/
+static void enter(void){
+
+    reader *r = join();
+    if (depth++ == 0) {
+        __atomic_store_n(&r->state, __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+        // nothing in the table may be read before the epoch is published
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+/*
+*  static void leave(void):
+*
+*  Marks the calling thread as outside every table.
+*/
+static void leave(void){
+
+    if (--depth == 0) {
+        __atomic_store_n(&self->state, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+*  static void release(const ConcurrentHashADT t, retired *r):
+*
+*  @param t: The table r was retired from.
+*  @param r: The retired array, pair or value, which is freed.
+*/
+static void release(const ConcurrentHashADT t, retired *r){
+
+    if (r->arr != NULL) {
+        free(r->arr);
+    } else if (t->delete != NULL) {
+        t->delete(r->key, r->value);
+    }
+    free(r);
+}
+
+/*
+*  static void sweep(ConcurrentHashADT t):
+*
+*  Releases every retired entry older than the epoch of each thread
+*  still inside a table.  The caller holds retire_lock.
+*
+*  @param t: The table.
+*/
+static void sweep(ConcurrentHashADT t){
+
+    uint64_t oldest = UINT64_MAX;
+    for (reader *r = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        uint64_t state = __atomic_load_n(&r->state, __ATOMIC_SEQ_CST);
+        if (state != 0 && state < oldest) {
+            oldest = state;
+        }
+    }
+
+    retired **link = &t->retired;
+    while (*link != NULL) {
+        retired *r = *link;
+        if (r->epoch < oldest) {
+            *link = r->next;
+            release(t, r);
+            t->retired_count--;
+        } else {
+            link = &r->next;
+        }
+    }
+
+    __atomic_store_n(&t->retired_count, t->retired_count, __ATOMIC_RELAXED);
+    t->sweep_at = t->retired_count + CHT_RETIRE_BATCH;
+}
+
+/*
+*  static void retire(ConcurrentHashADT t, array *a, void *key, void *value):
+*
+*  Puts an array, or a pair, on the retired list in a new epoch.
+*
+*  @param t: The table.
+*  @param a: The array replaced by a rehash, or NULL for a pair.
+*  @param key: The key of the pair.
+*  @param value: The value of the pair.
+*/
+static void retire(ConcurrentHashADT t, array *a, void *key, void *value){
+
+    retired *r = malloc(sizeof(retired));
+    assert(r != NULL);
+    r->arr = a;
+    r->key = key;
+    r->value = value;
+
+    pthread_mutex_lock(&t->retire_lock);
+
+    r->epoch = __atomic_fetch_add(&global_epoch, 1, __ATOMIC_SEQ_CST);
+    r->next = t->retired;
+    t->retired = r;
+    __atomic_store_n(&t->retired_count, t->retired_count + 1, __ATOMIC_RELAXED);
+
+    if (a != NULL || t->retired_count >= t->sweep_at) {
+        sweep(t);
+    }
+
+    pthread_mutex_unlock(&t->retire_lock);
+}
+
+/*
+*  static array *alloc_array(size_t capacity):
+*
+*  @param capacity: The number of slots.
+*  @return: Returns an array of empty slots.
+*/
+static array *alloc_array(size_t capacity){
+
+    array *a = calloc(1, sizeof(array) + capacity * sizeof(slot));
+    assert(a != NULL);
+    a->capacity = capacity;
+
+    return a;
+}
+
+/*
+*  static size_t limit(const array *a):
+*
+*  @param a: An array.
+*  @return: Returns the number of slots that may be used before a rehash.
+*/
+static size_t limit(const array *a){
+    return (size_t)(a->capacity * CHT_LOAD_THRESHOLD);
+}
+
+/*
+*  static size_t capacity_for(size_t entries):
+*
+*  @param entries: A number of entries.
+*  @return: Returns the smallest capacity holding them below the load threshold.
+*/
+static size_t capacity_for(size_t entries){
+
+    size_t capacity = CHT_INITIAL_CAPACITY;
+    while ((double)entries / capacity > CHT_LOAD_THRESHOLD) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+/*
+*  static pthread_mutex_t *stripe_of(ConcurrentHashADT t, size_t code):
+*
+*  @param t: The table.
+*  @param code: A key's hash code.
+*  @return: Returns the lock writers of that key take.
+*/
+static pthread_mutex_t *stripe_of(ConcurrentHashADT t, size_t code){
+    return &t->stripes[code % CHT_STRIPES].lock;
+}
+
+/*
+*  static slot *locate(const ConcurrentHashADT t, array *a, const void *key, size_t code):
+*
+*  Walks the probe chain of key from its home slot to the first empty
+*  slot.  Slots being filled or removed are stepped over, and equals()
+*  is only called on slots whose hash code matches.
+*
+*  @param t: The table.
+*  @param a: The array to search.
+*  @param key: The key.
+*  @param code: The hash code of key.
+*  @return: Returns the slot holding key, or NULL.
+*/
+static slot *locate(const ConcurrentHashADT t, array *a, const void *key, size_t code){
+
+    for (size_t i = code % a->capacity; ; i = (i + 1) % a->capacity) {
+        slot *s = &a->slots[i];
+        void *k = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE);
+        if (k == NULL) {
+            return NULL;
+        }
+        if (k != BUSY && k != REMOVED && s->hash == code && t->equals(k, key)) {
+            return s;
+        }
+    }
+}
+
+/*
+*  static void rehash(ConcurrentHashADT t, array *seen):
+*
+*  Locks every stripe, then moves the live entries of the current
+*  array into a new one, dropping REMOVED slots.  The new array is
+*  twice as large unless removed slots, not entries, filled the old
+*  one.  Nothing is done if another writer already replaced seen.
+*
+*  @param t: The table.
+*  @param seen: The array the caller found full.
+*/
+static void rehash(ConcurrentHashADT t, array *seen){
+
+    for (size_t i = 0; i < CHT_STRIPES; ++i) {
+        pthread_mutex_lock(&t->stripes[i].lock);
+    }
+
+    array *a = t->cur;
+    if (a == seen) {
+        size_t capacity = a->capacity;
+        size_t size = __atomic_load_n(&t->size, __ATOMIC_RELAXED);
+        if ((double)(size + 1) / capacity > CHT_LOAD_THRESHOLD / 2) {
+            capacity *= 2;
+        }
+
+        // no writer is inside, so nothing here can change
+        array *b = alloc_array(capacity);
+        for (size_t i = 0; i < a->capacity; ++i) {
+            slot *s = &a->slots[i];
+            if (s->key != NULL && s->key != REMOVED) {
+                size_t j = s->hash % capacity;
+                while (b->slots[j].key != NULL) {
+                    j = (j + 1) % capacity;
+                }
+                b->slots[j] = *s;
+                b->used++;
+            }
+        }
+
+        __atomic_store_n(&t->cur, b, __ATOMIC_RELEASE);
+        __atomic_store_n(&t->rehashes, t->rehashes + 1, __ATOMIC_RELAXED);
+        retire(t, a, NULL, NULL);
+    }
+
+    for (size_t i = CHT_STRIPES; i-- > 0; ) {
+        pthread_mutex_unlock(&t->stripes[i].lock);
+    }
+}
+
+/*
+*  static void *insert(ConcurrentHashADT t, const void *key, const void *value, bool replace):
+*
+*  Under the key's stripe, looks the key up and either updates it or
+*  reserves a slot and claims the first empty one of the chain.  Other
+*  stripes may claim slots of the same chain meanwhile, in which case
+*  the claim moves on along it.  A full array is rehashed and the
+*  insertion started again.
+*
+*  @param t: The table.
+*  @param key: The key.
+*  @param value: The value.
+*  @param replace: Whether an existing key's value is replaced.
+*  @return: Returns the value the key already had, or NULL.
+*/
+static void *insert(ConcurrentHashADT t, const void *key, const void *value, bool replace){
+
+    assert(t != NULL && key != NULL && value != NULL);
+
+    size_t code = t->hash(key);
+    pthread_mutex_t *lock = stripe_of(t, code);
+
+    for (;;) {
+        enter();
+        pthread_mutex_lock(lock);
+
+        array *a = __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE);
+        slot *s = locate(t, a, key, code);
+        if (s != NULL) {
+            void *old = __atomic_load_n(&s->value, __ATOMIC_ACQUIRE);
+            if (replace) {
+                __atomic_store_n(&s->value, (void *)value, __ATOMIC_RELEASE);
+            }
+            pthread_mutex_unlock(lock);
+            leave();
+            return old;
+        }
+
+        if (__atomic_add_fetch(&a->used, 1, __ATOMIC_RELAXED) <= limit(a)) {
+            for (size_t i = code % a->capacity; ; i = (i + 1) % a->capacity) {
+                void *expected = NULL;
+                s = &a->slots[i];
+                if (__atomic_load_n(&s->key, __ATOMIC_RELAXED) == NULL
+                        && __atomic_compare_exchange_n(&s->key, &expected, BUSY, false,
+                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                    break;
+                }
+            }
+
+            s->hash = code;
+            __atomic_store_n(&s->value, (void *)value, __ATOMIC_RELAXED);
+            __atomic_store_n(&s->key, (void *)key, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&t->size, 1, __ATOMIC_RELAXED);
+
+            pthread_mutex_unlock(lock);
+            leave();
+            return NULL;
+        }
+
+        __atomic_sub_fetch(&a->used, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(lock);
+        leave();
+
+        rehash(t, a);
+    }
+}
+
+/*
+*  ConcurrentHashADT cht_create:
+*  creates a new table sized to hold a number of entries without growing
+*
+*  @param hash: A function pointer to the hash function that hashes keys.
+*  @param equals: A function pointer to the comparison function that checks equality between keys.
+*  @param print: A function pointer to the function that prints key-value pairs.
+*  @param delete: A function pointer to the function that deletes key-value pairs.
+*  @param entries: The number of entries to reserve room for.
+*
+*  Returns a ConcurrentHashADT.
+*/
+ConcurrentHashADT cht_create(
+    size_t (*hash)(const void *key),
+    bool (*equals)(const void *key1, const void *key2),
+    void (*print)(const void *key, const void *value),
+    void (*delete)(void *key, void *value),
+    size_t entries
+){
+    assert(hash != NULL && equals != NULL && print != NULL);
+
+    ConcurrentHashADT t = malloc(sizeof(chtab));
+    assert(t != NULL);
+
+    t->hash = hash;
+    t->equals = equals;
+    t->print = print;
+    t->delete = delete;
+    t->size = 0;
+    t->rehashes = 0;
+    t->cur = alloc_array(capacity_for(entries));
+
+    for (size_t i = 0; i < CHT_STRIPES; ++i) {
+        pthread_mutex_init(&t->stripes[i].lock, NULL);
+    }
+
+    pthread_mutex_init(&t->retire_lock, NULL);
+    t->retired = NULL;
+    t->retired_count = 0;
+    t->sweep_at = CHT_RETIRE_BATCH;
+
+    return t;
+}
+
+/*
+*  struct cht_destroy:
+*
+*  Calls the delete function on every pair still in the table, releases
+*  everything retired regardless of epochs, since no other thread may
+*  be using the table, and frees the table.
+*
+*  @param t: The table to be destroyed.
+*/
+void cht_destroy(ConcurrentHashADT t){
+
+    if (t == NULL) {
+        return;
+    }
+
+    if (t->delete != NULL) {
+        for (size_t i = 0; i < t->cur->capacity; ++i) {
+            slot *s = &t->cur->slots[i];
+            if (s->key != NULL && s->key != REMOVED) {
+                t->delete(s->key, s->value);
+            }
+        }
+    }
+    free(t->cur);
+
+    while (t->retired != NULL) {
+        retired *r = t->retired;
+        t->retired = r->next;
+        release(t, r);
+    }
+
+    for (size_t i = 0; i < CHT_STRIPES; ++i) {
+        pthread_mutex_destroy(&t->stripes[i].lock);
+    }
+    pthread_mutex_destroy(&t->retire_lock);
+
+    free(t);
+}
+
+/*
+*  struct cht_dump:
+*
+*  Prints the table's counters and, if asked, its contents, reading the
+*  current array as lookups do.
+*
+*  @param t: The table to be displayed.
+*  @param contents: Whether to print every entry.
+*/
+void cht_dump(const ConcurrentHashADT t, bool contents){
+
+    if (t == NULL) {
+        printf("The hash table is NULL.\n");
+        return;
+    }
+
+    enter();
+
+    array *a = __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE);
+    size_t removed = 0;
+    for (size_t i = 0; i < a->capacity; ++i) {
+        if (__atomic_load_n(&a->slots[i].key, __ATOMIC_RELAXED) == REMOVED) {
+            removed++;
+        }
+    }
+
+    printf("Concurrent Hash Table Information:\n");
+    printf("Size: %zu, Capacity: %zu, Removed: %zu, Rehashes: %zu, Retired: %zu\n",
+           cht_size(t), a->capacity, removed,
+           __atomic_load_n(&t->rehashes, __ATOMIC_RELAXED),
+           __atomic_load_n(&t->retired_count, __ATOMIC_RELAXED));
+
+    if (contents) {
+        printf("Hash Table Contents:\n");
+        for (size_t i = 0; i < a->capacity; ++i) {
+            slot *s = &a->slots[i];
+            void *k = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE);
+            void *v = __atomic_load_n(&s->value, __ATOMIC_ACQUIRE);
+            if (k != NULL && k != BUSY && k != REMOVED && v != NULL) {
+                printf("Bucket %zu: ", i);
+                t->print(k, v);
+                printf("\n");
+            }
+        }
+    }
+
+    leave();
+}
+
+/*
+*  struct cht_size:
+*
+*  @param t: The table.
+*  @return: Returns the number of entries.
+*/
+size_t cht_size(const ConcurrentHashADT t){
+    return __atomic_load_n(&t->size, __ATOMIC_RELAXED);
+}
+
+/*
+*  struct cht_find:
+*
+*  A value read as NULL belongs to a key being removed, which is then
+*  already gone.
+*
+*  @param t: The table.
+*  @param key: The key to look up.
+*  @return: Returns the key's value, or NULL.
+*/
+void *cht_find(const ConcurrentHashADT t, const void *key){
+
+    assert(t != NULL && key != NULL);
+
+    size_t code = t->hash(key);
+
+    enter();
+    slot *s = locate(t, __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE), key, code);
+    void *value = s != NULL ? __atomic_load_n(&s->value, __ATOMIC_ACQUIRE) : NULL;
+    leave();
+
+    return value;
+}
+
+/*
+*  struct cht_has:
+*
+*  @param t: The table.
+*  @param key: The key to look up.
+*  @return: Returns true if the key is in the table.
+*/
+bool cht_has(const ConcurrentHashADT t, const void *key){
+    return cht_find(t, key) != NULL;
+}
+
+/*
+*  struct cht_put:
+*
+*  @param t: The table.
+*  @param key: The key.
+*  @param value: The value.
+*  @return: Returns the key's old value, or NULL if it was added.
+*/
+void *cht_put(ConcurrentHashADT t, const void *key, const void *value){
+    return insert(t, key, value, true);
+}
+
+/*
+*  struct cht_put_if_absent:
+*
+*  @param t: The table.
+*  @param key: The key.
+*  @param value: The value.
+*  @return: Returns the key's existing value, or NULL if the pair was added.
+*/
+void *cht_put_if_absent(ConcurrentHashADT t, const void *key, const void *value){
+    return insert(t, key, value, false);
+}
+
+/*
+*  struct cht_remove:
+*
+*  Clears the value before marking the key REMOVED, so a lookup that
+*  already matched the key sees it gone rather than reading a value
+*  the client may be about to retire.
+*
+*  @param t: The table.
+*  @param key: The key to be removed.
+*  @param removed_key: Out parameter receiving the stored key, if not NULL.
+*  @return: Returns the removed value, or NULL if the key was not found.
+*/
+void *cht_remove(ConcurrentHashADT t, const void *key, void **removed_key){
+
+    assert(t != NULL && key != NULL);
+
+    size_t code = t->hash(key);
+    pthread_mutex_t *lock = stripe_of(t, code);
+
+    enter();
+    pthread_mutex_lock(lock);
+
+    void *value = NULL;
+    slot *s = locate(t, __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE), key, code);
+    if (s != NULL) {
+        value = __atomic_load_n(&s->value, __ATOMIC_RELAXED);
+        if (removed_key != NULL) {
+            *removed_key = __atomic_load_n(&s->key, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&s->value, NULL, __ATOMIC_RELEASE);
+        __atomic_store_n(&s->key, REMOVED, __ATOMIC_RELEASE);
+        __atomic_sub_fetch(&t->size, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(lock);
+    leave();
+
+    return value;
+}
+
+/*
+*  struct cht_retire:
+*
+*  @param t: The table the pair was removed from.
+*  @param key: The removed key.
+*  @param value: The removed value.
+*/
+void cht_retire(ConcurrentHashADT t, void *key, void *value){
+
+    assert(t != NULL);
+
+    if (t->delete != NULL) {
+        retire(t, NULL, key, value);
+    }
+}
+
+/*
+*  struct cht_retire_value:
+*
+*  @param t: The table the value was replaced in.
+*  @param value: The replaced value.
+*/
+void cht_retire_value(ConcurrentHashADT t, void *value){
+
+    assert(t != NULL);
+
+    if (t->delete != NULL) {
+        retire(t, NULL, NULL, value);
+    }
+}
+
+/*
+*  struct cht_enter:
+*
+*  Lookups enter on their own; this only widens the window to the
+*  caller's.
+*/
+void cht_enter(void){
+    enter();
+}
+
+/*
+*  struct cht_leave:
+*/
+void cht_leave(void){
+
+    assert(depth > 0);
+
+    leave();
+}
+
+/*
+*  struct cht_foreach:
+*
+*  Walks the array that was current when the walk began; a rehash
+*  during the walk leaves it readable until the walk ends.
+*
+*  @param t: The table.
+*  @param visit: The function called with each pair.
+*  @param arg: Passed through to visit.
+*/
+void cht_foreach(const ConcurrentHashADT t, void (*visit)(void *key, void *value, void *arg), void *arg){
+
+    assert(t != NULL && visit != NULL);
+
+    enter();
+
+    array *a = __atomic_load_n(&t->cur, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < a->capacity; ++i) {
+        slot *s = &a->slots[i];
+        void *k = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE);
+        if (k != NULL && k != BUSY && k != REMOVED) {
+            void *v = __atomic_load_n(&s->value, __ATOMIC_ACQUIRE);
+            if (v != NULL) {
+                visit(k, v, arg);
+            }
+        }
+    }
+
+    leave();
+}
@@ -0,0 +1,270 @@
+/// \file ConcurrentHashADT.h
+/// \brief A generic hash table that many threads may use at once.
+///
+/// @author Connor Patterson
+
+#ifndef CONCURRENTHASHADT_H
+#define CONCURRENTHASHADT_H
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+
+/// Initial capacity of table upon creation
+#define CHT_INITIAL_CAPACITY 16
+
+/// The load, counting removed slots, at which the table will rehash
+#define CHT_LOAD_THRESHOLD 0.75
+
+/// Number of locks writers are spread over
+#define CHT_STRIPES 64
+
+/// Removed pairs held back before the table tries to release them
+#define CHT_RETIRE_BATCH 64
+
+///
+/// General Notes on concurrent hash table Operation
+///
+/// - The table takes the same hash, equals, print and delete functions
+///   as HashADT, and owns its keys and values in the same way.  Values
+///   may not be NULL, which is how a lookup reports a missing key.
+///
+/// - Lookups (cht_find(), cht_has(), cht_size(), cht_foreach() and
+///   cht_dump()) take no locks and never wait for a writer.  Writers
+///   lock one of CHT_STRIPES locks, chosen by the key's hash, so writes
+///   to keys in different stripes run in parallel; a rehash locks them
+///   all.  The hash and equals functions must be safe to call from
+///   several threads at once.
+///
+/// - Every single-key operation is atomic: a lookup sees a key either
+///   entirely before or entirely after any put or remove of it.  Walks
+///   over the whole table see each key that stays in it throughout
+///   exactly once, and keys added or removed during the walk at most
+///   once.
+///
+/// - Arrays replaced by a rehash, and pairs handed to cht_retire(), are
+///   released only once every lookup that could still be reading them
+///   has finished.  Threads need no registration for this.
+///
+/// - A lookup that was under way when a pair was removed may still be
+///   comparing its key or returning its value, and the same goes for a
+///   value replaced by cht_put(), so neither may be freed directly; hand
+///   a removed pair to cht_retire(), and a replaced value, whose key is
+///   still in the table, to cht_retire_value().
+///
+/// - The value cht_find() returns may be removed and retired by another
+///   thread as soon as the lookup returns.  A client that goes on to
+///   read it must look it up and read it between cht_enter() and
+///   cht_leave(), which keep everything retired meanwhile, from any
+///   table, from being released.  Guards nest, and should be short,
+///   since nothing is released while any thread is inside one.
+///
+/// - cht_destroy() may not run at the same time as any other operation.
+///
+/// - Wherever a function has a precondition, and the client violates the
+///   condition, and the code detects the violation, then the function will
+///   assert failure and abort.
+///
+
+///
+/// The ConcurrentHashADT data type is a pointer to an opaque structure;
+/// clients cannot see the structure's content.
+///
+typedef struct chtab_s *ConcurrentHashADT;
+
+///
+/// Create a new concurrent hash table instance with room for a number of
+/// entries.  If delete is NULL, destroying the table will NOT free the
+/// (key,value) data pairs.
+///
+/// @param hash The hash function for key data
+/// @param equals The equal function for key comparison
+/// @param print The print function for key, value pairs is used by dump().
+/// @param delete The delete function for key, value pairs is used by
+///               destroy() and retire().
+/// @param entries The number of entries to reserve room for
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @pre hash, equals and print are valid function pointers.
+///
+/// @return A newly created table
+///
+ConcurrentHashADT cht_create(
+    size_t (*hash)( const void *key ),
+    bool (*equals)( const void *key1, const void *key2 ),
+    void (*print)( const void *key, const void *value ),
+    void (*delete)( void *key, void *value ),
+    size_t entries
+);
+
+///
+/// Destroy the table instance, call the delete function on each
+/// (key,value) pair, and release every retired pair.
+///
+/// @param t The table to destroy, or NULL
+///
+/// @pre No other thread is using t.
+///
+/// @post t is not a valid instance of table.
+///
+void cht_destroy( ConcurrentHashADT t );
+
+///
+/// Print information about the table (size, capacity, removed slots
+/// waiting for a rehash, rehashes, and pairs waiting to be released).
+/// If contents is true, also print every entry using the registered
+/// print function.
+///
+/// @param t The table to display
+/// @param contents Do a full dump including the entire table contents
+///
+/// @pre t is a valid instance of table.
+///
+void cht_dump( const ConcurrentHashADT t, bool contents );
+
+///
+/// @param t The table
+///
+/// @pre t is a valid instance of table.
+///
+/// @return The number of entries in the table
+///
+size_t cht_size( const ConcurrentHashADT t );
+
+///
+/// Find the value associated with a key, without taking any lock.
+///
+/// @param t The table
+/// @param key The key
+///
+/// @pre t is a valid instance of table, and key is not NULL.
+///
+/// @return The value associated with the key, or NULL if there is none.
+///         Outside cht_enter() the value may be released as soon as
+///         the lookup returns.
+///
+void *cht_find( const ConcurrentHashADT t, const void *key );
+
+///
+/// Check if the table has a key, without taking any lock.
+///
+/// @param t The table
+/// @param key The key
+///
+/// @pre t is a valid instance of table, and key is not NULL.
+///
+/// @return Whether the key exists in the table.
+///
+bool cht_has( const ConcurrentHashADT t, const void *key );
+
+///
+/// Add a key value pair to the table, or update an existing key's
+/// value.  An existing key keeps the key pointer it was added with.
+///
+/// @param t The table
+/// @param key The key
+/// @param value The value
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @pre t is a valid instance of table, and neither key nor value is NULL.
+///
+/// @return The old value associated with the key, if one exists.  The
+///         key stays in the table, so the old value is released through
+///         cht_retire_value().
+///
+void *cht_put( ConcurrentHashADT t, const void *key, const void *value );
+
+///
+/// Add a key value pair to the table unless the key is already there,
+/// as one atomic step.
+///
+/// @param t The table
+/// @param key The key
+/// @param value The value
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @pre t is a valid instance of table, and neither key nor value is NULL.
+///
+/// @return NULL if the pair was added, otherwise the value already
+///         associated with the key (the table is then unchanged)
+///
+void *cht_put_if_absent( ConcurrentHashADT t, const void *key, const void *value );
+
+///
+/// Remove a key and its value from the table.  The delete function is
+/// NOT called; the client takes back the stored key and value, but
+/// must release them through cht_retire().
+///
+/// @param t The table
+/// @param key The key
+/// @param removed_key If not NULL, receives the key pointer the table held
+///
+/// @pre t is a valid instance of table, and key is not NULL.
+///
+/// @return The value that was associated with the key, or NULL if the
+///         key was not in the table.
+///
+void *cht_remove( ConcurrentHashADT t, const void *key, void **removed_key );
+
+///
+/// Hand a removed pair to the table, which calls the delete function on
+/// it once no lookup can still be reading it (nothing is freed if the
+/// delete function is NULL).
+///
+/// @param t The table the pair was removed from
+/// @param key The removed key
+/// @param value The removed value
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @pre t is a valid instance of table.
+///
+void cht_retire( ConcurrentHashADT t, void *key, void *value );
+
+///
+/// Hand a value replaced by cht_put() to the table, which calls the
+/// delete function on it, with a NULL key, once no lookup can still be
+/// reading it (nothing is freed if the delete function is NULL).
+///
+/// @param t The table the value was replaced in
+/// @param value The replaced value
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @pre t is a valid instance of table, and its delete function accepts
+///      a NULL key.
+///
+void cht_retire_value( ConcurrentHashADT t, void *value );
+
+///
+/// Begin a read that outlasts a lookup: values found before the matching
+/// cht_leave() are not released, whatever is retired meanwhile.  Covers
+/// every table, and calls nest.
+///
+void cht_enter( void );
+
+///
+/// End a read begun by cht_enter().
+///
+/// @pre The calling thread is inside cht_enter().
+///
+void cht_leave( void );
+
+///
+/// Call a function on every (key,value) pair of the table, in slot
+/// order, without taking any lock.  Writers may run during the walk,
+/// and visit may itself modify the table.
+///
+/// @param t The table
+/// @param visit The function called with each key, value and arg
+/// @param arg Client data handed to every call of visit
+///
+/// @pre t is a valid instance of table, and visit is a valid function pointer.
+///
+void cht_foreach( const ConcurrentHashADT t,
+                  void (*visit)( void *key, void *value, void *arg ),
+                  void *arg );
+
+#endif // CONCURRENTHASHADT_H
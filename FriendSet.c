@@ -0,0 +1,220 @@
+/*
+* File: FriendSet.c
+* Decription:
+* implements an open-addressing set of member IDs, each mapped to its
+* position in an array the client owns
+*
+* Author: Connor Patterson
+*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include "FriendSet.h"
+
+/*
+*  struct entry_s:
+*  One slot of the set; an empty slot has member FRIENDSET_EMPTY.
+*/
+typedef struct entry_s {
+    uint32_t member;
+    uint32_t position;
+} entry;
+
+/*
+*  struct friendset_s:
+*  A structure representing a friend set
+*
+*  capacity is always a power of two, so mask picks a slot from a hash.
+*/
+typedef struct friendset_s {
+    Arena arena;
+    entry *slots;
+    size_t capacity;
+    size_t count;
+} friendset;
+
+
+/*
+*  static size_t home(const FriendSet s, uint32_t member):
+*
+*  IDs are dense, so a Fibonacci multiply spreads runs of them over the
+*  whole word before masking.
+*
+*  @param s: The set.
+*  @param member: A member ID.
+*  @return: Returns the slot the member hashes to.
+*/
+static size_t home(const FriendSet s, uint32_t member){
+    uint64_t code = (uint64_t)member * UINT64_C(0x9E3779B97F4A7C15);
+    return (size_t)(code >> 32) & (s->capacity - 1);
+}
+
+/*
+*  static void alloc_slots(FriendSet s, size_t capacity):
+*
+*  Gives the set a fresh, empty slot array of the given capacity.
+*
+*  @param s: The set.
+*  @param capacity: The number of slots, a power of two.
+*/
+static void alloc_slots(FriendSet s, size_t capacity){
+
+    s->slots = arena_alloc(s->arena, capacity * sizeof(entry));
+    s->capacity = capacity;
+
+    for (size_t i = 0; i < capacity; ++i) {
+        s->slots[i].member = FRIENDSET_EMPTY;
+    }
+}
+
+/*
+*  static void grow(FriendSet s):
+*
+*  Doubles the slot array and reinserts every member.
+*
+*  @param s: The set.
+*/
+static void grow(FriendSet s){
+
+    entry *old = s->slots;
+    size_t old_capacity = s->capacity;
+
+    alloc_slots(s, old_capacity * 2);
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old[i].member != FRIENDSET_EMPTY) {
+            size_t j = home(s, old[i].member);
+            while (s->slots[j].member != FRIENDSET_EMPTY) {
+                j = (j + 1) & (s->capacity - 1);
+            }
+            s->slots[j] = old[i];
+        }
+    }
+
+    arena_free(s->arena, old, old_capacity * sizeof(entry));
+}
+
+/*
+*  struct fs_create:
+*
+*  @param a: The arena the set allocates from.
+*  @param entries: The number of members expected.
+*  @return: Returns a new, empty set.
+*/
+FriendSet fs_create(Arena a, size_t entries){
+
+    FriendSet s = arena_alloc(a, sizeof(friendset));
+    s->arena = a;
+    s->count = 0;
+
+    size_t capacity = 8;
+    while (capacity * FRIENDSET_LOAD < entries + 1) {
+        capacity *= 2;
+    }
+    alloc_slots(s, capacity);
+
+    return s;
+}
+
+/*
+*  struct fs_destroy:
+*
+*  Hands the slot array and the set itself back to the arena.
+*
+*  @param s: The set to be destroyed.
+*/
+void fs_destroy(FriendSet s){
+
+    if (s == NULL) {
+        return;
+    }
+
+    arena_free(s->arena, s->slots, s->capacity * sizeof(entry));
+    arena_free(s->arena, s, sizeof(friendset));
+}
+
+/*
+*  struct fs_find:
+*
+*  @param s: The set.
+*  @param member: The member to look up.
+*  @return: Returns the member's position, or SIZE_MAX if it is absent.
+*/
+size_t fs_find(const FriendSet s, uint32_t member){
+
+    for (size_t i = home(s, member); s->slots[i].member != FRIENDSET_EMPTY; i = (i + 1) & (s->capacity - 1)) {
+        if (s->slots[i].member == member) {
+            return s->slots[i].position;
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+/*
+*  struct fs_put:
+*
+*  Updates the member's position, or claims the first empty slot on its
+*  probe sequence for it.
+*
+*  @param s: The set.
+*  @param member: The member.
+*  @param position: The position to record.
+*/
+void fs_put(FriendSet s, uint32_t member, size_t position){
+
+    assert(member != FRIENDSET_EMPTY && position <= UINT32_MAX);
+
+    if ((s->count + 1) > s->capacity * FRIENDSET_LOAD) {
+        grow(s);
+    }
+
+    size_t i = home(s, member);
+    while (s->slots[i].member != FRIENDSET_EMPTY) {
+        if (s->slots[i].member == member) {
+            s->slots[i].position = (uint32_t)position;
+            return;
+        }
+        i = (i + 1) & (s->capacity - 1);
+    }
+
+    s->slots[i].member = member;
+    s->slots[i].position = (uint32_t)position;
+    s->count++;
+}
+
+/*
+*  struct fs_remove:
+*
+*  Empties the member's slot and shifts later entries of the cluster back
+*  over it (Knuth's Algorithm R), so no tombstones build up.
+*
+*  @param s: The set.
+*  @param member: The member to remove.
+*/
+void fs_remove(FriendSet s, uint32_t member){
+
+    size_t mask = s->capacity - 1;
+    size_t i = home(s, member);
+
+    while (s->slots[i].member != member) {
+        if (s->slots[i].member == FRIENDSET_EMPTY) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    s->count--;
+
+    for (size_t j = (i + 1) & mask; s->slots[j].member != FRIENDSET_EMPTY; j = (j + 1) & mask) {
+        // an entry may move back to the hole only if its home slot is not
+        // between the hole and where it sits now
+        size_t h = home(s, s->slots[j].member);
+        if (((j - h) & mask) >= ((j - i) & mask)) {
+            s->slots[i] = s->slots[j];
+            i = j;
+        }
+    }
+
+    s->slots[i].member = FRIENDSET_EMPTY;
+}
@@ -0,0 +1,95 @@
+/// \file FriendSet.h
+/// \brief An index over a person's friends array for high-degree accounts.
+///
+/// @author Connor Patterson
+
+#ifndef FRIENDSET_H
+#define FRIENDSET_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+#include "Arena.h"
+
+/// Degree at which a person's friends array gets an index
+#define FRIENDSET_THRESHOLD 32
+
+/// Maximum fraction of slots in use before the set doubles
+#define FRIENDSET_LOAD 0.5
+
+/// The one ID that cannot be a member; it marks an empty slot
+#define FRIENDSET_EMPTY UINT32_MAX
+
+///
+/// General Notes on friend set Operation
+///
+/// - A friend set maps each member (a person ID) to the position it holds
+///   in some array owned by the client, so the client can find, and
+///   swap-remove, a member of that array in expected O(1) time.
+///
+/// - FRIENDSET_EMPTY cannot be a member.
+///
+/// - The set and its slots are allocated from the arena it was created
+///   with, and handed back to it by fs_destroy().
+///
+/// - Wherever a function has a precondition, and the client violates the
+///   condition, and the code detects the violation, then the function will
+///   assert failure and abort.
+///
+
+///
+/// The FriendSet data type is a pointer to an opaque structure.
+///
+typedef struct friendset_s *FriendSet;
+
+///
+/// Create a new, empty set with room for the given number of members
+/// before it has to grow.
+///
+/// @param a The arena the set allocates from
+/// @param entries The number of members expected
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @return A newly created set
+///
+FriendSet fs_create( Arena a, size_t entries );
+
+///
+/// Destroy the set, handing its memory back to its arena.
+///
+/// @param s The set to destroy, or NULL
+///
+/// @post s is not a valid instance of friend set.
+///
+void fs_destroy( FriendSet s );
+
+///
+/// @param s The set
+/// @param member The member to look up
+///
+/// @return The position recorded for member, or SIZE_MAX if it is not
+///         in the set
+///
+size_t fs_find( const FriendSet s, uint32_t member );
+
+///
+/// Record the position of a member, adding it to the set if it is not
+/// there yet.  The set doubles when it passes FRIENDSET_LOAD.
+///
+/// @param s The set
+/// @param member The member (not FRIENDSET_EMPTY)
+/// @param position The position to record
+///
+/// @exception Assert fails if it cannot allocate space
+///
+void fs_put( FriendSet s, uint32_t member, size_t position );
+
+///
+/// Remove a member from the set if it is there.
+///
+/// @param s The set
+/// @param member The member to remove
+///
+void fs_remove( FriendSet s, uint32_t member );
+
+#endif // FRIENDSET_H
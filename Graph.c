@@ -0,0 +1,428 @@
+/*
+* File: Graph.c
+* Decription:
+* implements an immutable compressed sparse row (CSR) graph: one array
+* of row offsets and one array of neighbours, each row sorted
+*
+* Author: Connor Patterson
+*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include "Graph.h"
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+*  struct graph_s:
+*  A structure representing a graph
+*
+*  The neighbours of vertex v are neighbours[offsets[v] .. offsets[v + 1]).
+*/
+typedef struct graph_s {
+    uint32_t vertices;
+    size_t *offsets;
+    uint32_t *neighbours;
+} graph;
+
+
+/*
+*  static void transpose(uint32_t vertices, const size_t *offsets, const uint32_t *neighbours, size_t *t_offsets, uint32_t *t_neighbours):
+*
+*  Builds the transpose of a CSR graph with a counting sort.  Sources are
+*  visited in ascending order, so every row of the transpose comes out
+*  sorted whatever order the input rows were in.
+*
+*  @param vertices: The number of vertices.
+*  @param offsets: The input's row offsets.
+*  @param neighbours: The input's neighbours.
+*  @param t_offsets: Receives the transpose's row offsets (vertices + 1).
+*  @param t_neighbours: Receives the transpose's neighbours.
+*/
+static void transpose(uint32_t vertices, const size_t *offsets, const uint32_t *neighbours,
+        size_t *t_offsets, uint32_t *t_neighbours){
+
+    for (uint32_t v = 0; v <= vertices; ++v) {
+        t_offsets[v] = 0;
+    }
+
+    // count each vertex's in-degree one slot ahead, then prefix-sum
+    for (size_t i = 0; i < offsets[vertices]; ++i) {
+        t_offsets[neighbours[i] + 1]++;
+    }
+    for (uint32_t v = 0; v < vertices; ++v) {
+        t_offsets[v + 1] += t_offsets[v];
+    }
+
+    // t_offsets[v] is used as the fill cursor of row v, ending up at the
+    // start of row v + 1; shifting afterwards restores the offsets
+    for (uint32_t u = 0; u < vertices; ++u) {
+        for (size_t i = offsets[u]; i < offsets[u + 1]; ++i) {
+            t_neighbours[t_offsets[neighbours[i]]++] = u;
+        }
+    }
+    for (uint32_t v = vertices; v > 0; --v) {
+        t_offsets[v] = t_offsets[v - 1];
+    }
+    t_offsets[0] = 0;
+}
+
+/*
+*  struct graph_build:
+*
+*  Copies the client's rows into a scratch CSR graph and transposes it
+*  twice.  Each transpose is linear and sorts its rows, and the second
+*  undoes the first, so the result is the client's graph with sorted
+*  rows in O(vertices + entries) time.
+*
+*  @param vertices: The number of vertices.
+*  @param row: Function returning the neighbours of a vertex.
+*  @param arg: Passed through to row.
+*  @return: Returns the new graph.
+*/
+Graph graph_build(uint32_t vertices,
+        size_t (*row)(uint32_t v, const uint32_t **neighbours, void *arg),
+        void *arg){
+
+    size_t *offsets = malloc(((size_t)vertices + 1) * sizeof(size_t));
+    assert(offsets != NULL);
+
+    offsets[0] = 0;
+    for (uint32_t v = 0; v < vertices; ++v) {
+        const uint32_t *list;
+        offsets[v + 1] = offsets[v] + row(v, &list, arg);
+    }
+
+    size_t entries = offsets[vertices];
+    uint32_t *scratch = malloc((entries > 0 ? entries : 1) * sizeof(uint32_t));
+    uint32_t *neighbours = malloc((entries > 0 ? entries : 1) * sizeof(uint32_t));
+    size_t *t_offsets = malloc(((size_t)vertices + 1) * sizeof(size_t));
+    assert(scratch != NULL && neighbours != NULL && t_offsets != NULL);
+
+    for (uint32_t v = 0; v < vertices; ++v) {
+        const uint32_t *list;
+        size_t degree = row(v, &list, arg);
+        assert(offsets[v] + degree == offsets[v + 1]);
+        for (size_t i = 0; i < degree; ++i) {
+            assert(list[i] < vertices);
+            scratch[offsets[v] + i] = list[i];
+        }
+    }
+
+    transpose(vertices, offsets, scratch, t_offsets, neighbours);
+    transpose(vertices, t_offsets, neighbours, offsets, scratch);
+
+    free(t_offsets);
+    free(neighbours);
+
+    Graph g = malloc(sizeof(graph));
+    assert(g != NULL);
+
+    g->vertices = vertices;
+    g->offsets = offsets;
+    g->neighbours = scratch;
+
+    return g;
+}
+
+/*
+*  struct graph_destroy:
+*
+*  @param g: The graph to be destroyed.
+*/
+void graph_destroy(Graph g){
+
+    if (g == NULL) {
+        return;
+    }
+
+    free(g->offsets);
+    free(g->neighbours);
+    free(g);
+}
+
+/*
+*  struct graph_vertices:
+*
+*  @param g: The graph.
+*  @return: Returns the number of vertices.
+*/
+uint32_t graph_vertices(const Graph g){
+    return g->vertices;
+}
+
+/*
+*  struct graph_entries:
+*
+*  @param g: The graph.
+*  @return: Returns the length of the neighbour array.
+*/
+size_t graph_entries(const Graph g){
+    return g->offsets[g->vertices];
+}
+
+/*
+*  struct graph_neighbours:
+*
+*  @param g: The graph.
+*  @param v: A vertex.
+*  @param degree: Out parameter receiving the number of neighbours.
+*  @return: Returns the start of the vertex's sorted neighbours.
+*/
+const uint32_t *graph_neighbours(const Graph g, uint32_t v, size_t *degree){
+
+    if (v >= g->vertices) {
+        *degree = 0;
+        return g->neighbours;
+    }
+
+    *degree = g->offsets[v + 1] - g->offsets[v];
+    return g->neighbours + g->offsets[v];
+}
+
+/*
+*  struct graph_has_edge:
+*
+*  @param g: The graph.
+*  @param u: A vertex.
+*  @param v: A vertex.
+*  @return: Returns true if v appears in the sorted row of u.
+*/
+bool graph_has_edge(const Graph g, uint32_t u, uint32_t v){
+
+    size_t degree;
+    const uint32_t *row = graph_neighbours(g, u, &degree);
+
+    size_t low = 0;
+    size_t high = degree;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (row[mid] < v) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low < degree && row[low] == v;
+}
+
+#if defined(__SSE2__) || defined(__AVX2__)
+/*
+*  static size_t emit(const uint32_t *block, unsigned hits, uint32_t *out, size_t count):
+*
+*  Appends the entries of a block picked out by a bit mask.
+*
+*  @param block: The block.
+*  @param hits: Bit k set for each entry k found in the other list.
+*  @param out: The output, or NULL when only counting.
+*  @param count: Entries output so far.
+*  @return: Returns the new count.
+*/
+static size_t emit(const uint32_t *block, unsigned hits, uint32_t *out, size_t count){
+
+    if (out == NULL) {
+        return count + (size_t)__builtin_popcount(hits);
+    }
+
+    while (hits != 0) {
+        out[count++] = block[__builtin_ctz(hits)];
+        hits &= hits - 1;
+    }
+
+    return count;
+}
+#endif
+
+/*
+*  static size_t merge(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count, uint32_t *out, size_t count):
+*
+*  Intersects two sorted lists one entry at a time.
+*
+*  @param a: A sorted list.
+*  @param a_count: Its length.
+*  @param b: A sorted list.
+*  @param b_count: Its length.
+*  @param out: The output, or NULL when only counting.
+*  @param count: Entries output so far.
+*  @return: Returns the new count.
+*/
+static size_t merge(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count,
+        uint32_t *out, size_t count){
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a_count && j < b_count) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            if (out != NULL) {
+                out[count] = a[i];
+            }
+            count++;
+            i++;
+            j++;
+        }
+    }
+
+    return count;
+}
+
+/*
+*  static size_t gallop(const uint32_t *small, size_t small_count, const uint32_t *large, size_t large_count, uint32_t *out):
+*
+*  Intersects a short sorted list with a much longer one, finding each
+*  entry of the short list by an exponential then a binary search that
+*  starts where the last one ended.
+*
+*  @param small: The shorter list.
+*  @param small_count: Its length.
+*  @param large: The longer list.
+*  @param large_count: Its length.
+*  @param out: The output, or NULL when only counting.
+*  @return: Returns the number of entries in both.
+*/
+static size_t gallop(const uint32_t *small, size_t small_count, const uint32_t *large, size_t large_count,
+        uint32_t *out){
+
+    size_t count = 0;
+    size_t low = 0;
+
+    for (size_t i = 0; i < small_count && low < large_count; ++i) {
+        uint32_t x = small[i];
+
+        // everything before low is below x; widen until large[high] is not
+        size_t high = low;
+        size_t step = 1;
+        while (high < large_count && large[high] < x) {
+            low = high + 1;
+            high += step;
+            step *= 2;
+        }
+        if (high > large_count) {
+            high = large_count;
+        }
+
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (large[mid] < x) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        if (low < large_count && large[low] == x) {
+            if (out != NULL) {
+                out[count] = x;
+            }
+            count++;
+            low++;
+        }
+    }
+
+    return count;
+}
+
+/*
+*  static size_t merge_blocks(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count, uint32_t *out):
+*
+*  Intersects two sorted lists a block at a time: every entry of a block
+*  of a is compared with every entry of a block of b at once, by
+*  comparing against each rotation of b's block, and whichever block
+*  ends lower (or both) moves on.  The entries left over are merged one
+*  at a time.
+*
+*  @param a: A sorted list.
+*  @param a_count: Its length.
+*  @param b: A sorted list.
+*  @param b_count: Its length.
+*  @param out: The output, or NULL when only counting.
+*  @return: Returns the number of entries in both.
+*/
+static size_t merge_blocks(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count,
+        uint32_t *out){
+
+    size_t i = 0;
+    size_t j = 0;
+    size_t count = 0;
+
+#ifdef __AVX2__
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+
+    while (i + 8 <= a_count && j + 8 <= b_count) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + j));
+
+        __m256i hit = _mm256_cmpeq_epi32(va, vb);
+        for (int k = 1; k < 8; ++k) {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(va, vb));
+        }
+        count = emit(a + i, (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(hit)), out, count);
+
+        uint32_t a_last = a[i + 7];
+        uint32_t b_last = b[j + 7];
+        i += a_last <= b_last ? 8 : 0;
+        j += b_last <= a_last ? 8 : 0;
+    }
+#endif
+
+#ifdef __SSE2__
+    while (i + 4 <= a_count && j + 4 <= b_count) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+
+        __m128i hit = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                             _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+                _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                             _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        count = emit(a + i, (unsigned)_mm_movemask_ps(_mm_castsi128_ps(hit)), out, count);
+
+        uint32_t a_last = a[i + 3];
+        uint32_t b_last = b[j + 3];
+        i += a_last <= b_last ? 4 : 0;
+        j += b_last <= a_last ? 4 : 0;
+    }
+#endif
+
+    return merge(a + i, a_count - i, b + j, b_count - j, out, count);
+}
+
+/*
+*  struct graph_intersect:
+*
+*  @param a: A sorted list of distinct vertices.
+*  @param a_count: Its length.
+*  @param b: A sorted list of distinct vertices.
+*  @param b_count: Its length.
+*  @param out: Receives the vertices in both, or NULL to only count them.
+*  @return: Returns the number of vertices in both lists.
+*/
+size_t graph_intersect(const uint32_t *a, size_t a_count,
+        const uint32_t *b, size_t b_count, uint32_t *out){
+
+    if (a_count > b_count) {
+        const uint32_t *list = a;
+        a = b;
+        b = list;
+        size_t length = a_count;
+        a_count = b_count;
+        b_count = length;
+    }
+
+    if (a_count == 0) {
+        return 0;
+    }
+
+    if (b_count / a_count >= GRAPH_GALLOP_RATIO) {
+        return gallop(a, a_count, b, b_count, out);
+    }
+
+    return merge_blocks(a, a_count, b, b_count, out);
+}
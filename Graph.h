@@ -0,0 +1,118 @@
+/// \file Graph.h
+/// \brief An immutable snapshot of a graph in compressed sparse row form.
+///
+/// @author Connor Patterson
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+#include <stdbool.h>    // bool
+
+/// Size ratio of two sorted lists beyond which intersecting them gallops
+/// through the longer list instead of merging the two
+#define GRAPH_GALLOP_RATIO 32
+
+///
+/// General Notes on graph Operation
+///
+/// - Vertices are the dense IDs 0 .. graph_vertices() - 1.  The
+///   neighbours of every vertex sit in one shared array, each vertex's
+///   run of it in ascending order, so a traversal reads memory in order
+///   and two neighbour lists can be merged or binary searched directly.
+///
+/// - A graph never changes once built.  It can be read while the
+///   structures it was built from keep changing, and from any number of
+///   threads at once.
+///
+/// - Wherever a function has a precondition, and the client violates the
+///   condition, and the code detects the violation, then the function will
+///   assert failure and abort.
+///
+
+///
+/// The Graph data type is a pointer to an opaque structure.
+///
+typedef struct graph_s *Graph;
+
+///
+/// Build a graph from the client's adjacency lists.
+///
+/// @param vertices The number of vertices
+/// @param row Function returning the number of neighbours of vertex v,
+///            and setting *neighbours to them in any order; a vertex
+///            that does not exist has none.  Every neighbour is less
+///            than vertices.
+/// @param arg Passed through to row
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @return A newly created graph
+///
+Graph graph_build( uint32_t vertices,
+    size_t (*row)( uint32_t v, const uint32_t **neighbours, void *arg ),
+    void *arg );
+
+///
+/// Destroy the graph.
+///
+/// @param g The graph to destroy, or NULL
+///
+/// @post g is not a valid instance of graph.
+///
+void graph_destroy( Graph g );
+
+///
+/// @param g The graph
+///
+/// @return The number of vertices
+///
+uint32_t graph_vertices( const Graph g );
+
+///
+/// @param g The graph
+///
+/// @return The number of entries in all neighbour lists together (twice
+///         the number of edges, for an undirected graph)
+///
+size_t graph_entries( const Graph g );
+
+///
+/// @param g The graph
+/// @param v A vertex; any v of graph_vertices() or more has no neighbours
+/// @param degree Set to the number of neighbours of v
+///
+/// @return The neighbours of v in ascending order
+///
+const uint32_t *graph_neighbours( const Graph g, uint32_t v, size_t *degree );
+
+///
+/// @param g The graph
+/// @param u A vertex
+/// @param v A vertex
+///
+/// @return true if v is a neighbour of u, found by binary search
+///
+bool graph_has_edge( const Graph g, uint32_t u, uint32_t v );
+
+///
+/// Intersect two sorted lists of distinct vertices, such as two rows of
+/// a graph.  Lists of similar length are merged, a block at a time with
+/// SSE2 or AVX2 compares when the compiler targets them; a list more
+/// than GRAPH_GALLOP_RATIO times longer than the other is galloped
+/// through instead.
+///
+/// @param a A list in ascending order
+/// @param a_count The length of a
+/// @param b A list in ascending order
+/// @param b_count The length of b
+/// @param out Receives the vertices in both lists in ascending order, or
+///            NULL to only count them; room for the shorter list's length
+///
+/// @return The number of vertices in both lists
+///
+size_t graph_intersect( const uint32_t *a, size_t a_count,
+                        const uint32_t *b, size_t b_count, uint32_t *out );
+
+#endif // GRAPH_H
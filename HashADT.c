@@ -9,9 +9,54 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include "HashADT.h" 
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+*  Marker stored in a slot of the old arrays once its entry has been
+*  migrated or removed during an incremental resize.  Lookups in the old
+*  arrays step over it; nothing is ever inserted into the old arrays, so
+*  the markers disappear when those arrays are freed.
+*/
+static char moved_marker;
+#define MOVED ((void *)&moved_marker)
+
+/*
+*  Control bytes kept by the HT_SWISS engine, one per slot: an empty
+*  slot, a migrated (or removed) old slot, or, for an occupied slot,
+*  7 bits taken from its hash code.  Probes compare GROUP_WIDTH control
+*  bytes at a time, so the array carries GROUP_WIDTH - 1 extra bytes
+*  mirroring its start, letting a group that wraps around be loaded
+*  with a single read.
+*/
+#define CTRL_EMPTY 0x80
+#define CTRL_MOVED 0xFE
+#define GROUP_WIDTH 16
+
+/*
+*  struct slots_s:
+*  One set of parallel slot arrays
+*
+*  Holds the keys, values and cached hash codes of capacity slots,
+*  and their control bytes when the table uses the HT_SWISS engine
+*  (ctrl is NULL otherwise).  The table keeps its current arrays in one
+*  of these, plus a second set for the arrays being drained while an
+*  incremental resize is in progress.
+*/
+typedef struct slots_s {
+    size_t capacity;
+    void **keys;
+    void **values;
+    size_t *hashes;
+    unsigned char *ctrl;
+} slots;
+
 /*
 *  struct hashtab_s: 
 *  A structure representing a hash table
@@ -19,28 +64,233 @@
 *  This structure manages key-value pairs within a hash table. 
 *  It includes members for tracking table metrics,
 *  such as capacity, size, load threshold, resize factor, 
-*  collision count, and rehash count.
+*  collision count, and rehash count, and whether the table may
+*  shrink when entries are removed.  Shrinking never takes the table
+*  below min_capacity, the capacity reserved by the client.
+*
+*  Alongside each key the table caches the full hash code the client
+*  hash function produced for it, so rehashing never calls hash() again
+*  and probes skip equals() for slots whose cached code differs.
+*
+*  With incremental resizing enabled (migrate_step > 0), a resize only
+*  allocates the new arrays; the previous ones are kept in old and
+*  migrate_step of their slots are moved over by each later operation,
+*  starting at migrate_pos.  old_size counts the entries not yet moved.
+*
+*  engine selects the probing strategy used by every slot set of the
+*  table (see HashEngine).
 */
 typedef struct hashtab_s {
     
-    size_t capacity; 
     size_t size; 
     float load_threshold; 
     size_t resize_factor; 
     size_t collisions; 
     size_t rehashes; 
+    bool shrink; 
+    size_t min_capacity; 
+    HashEngine engine;
 
     size_t (*hash)(const void *key); 
     bool (*equals)(const void *key1, const void *key2); 
     void (*print)(const void *key, const void *value); 
     void (*delete)(void *key, void *value); 
 
-    void **keys; 
-    void **values; 
+    slots cur;
+
+    slots old;
+    size_t old_size;
+    size_t migrate_pos;
+    size_t migrate_step;
 
 } hashtab;
 
 
+/*
+*  static void alloc_slots(const HashADT t, slots *s, size_t capacity):
+*
+*  Allocates zeroed (empty) arrays of capacity slots, with control bytes
+*  if the table uses the HT_SWISS engine.
+*
+*  @param t: The Hash Table instance.
+*  @param s: The slot set to be allocated.
+*  @param capacity: The number of slots.
+*/
+static void alloc_slots(const HashADT t, slots *s, size_t capacity){
+
+    assert(capacity >= GROUP_WIDTH);
+
+    s->capacity = capacity;
+    s->keys = (void **)calloc(capacity, sizeof(void *));
+    s->values = (void **)calloc(capacity, sizeof(void *));
+    s->hashes = (size_t *)calloc(capacity, sizeof(size_t));
+    s->ctrl = NULL;
+
+    // Exception handling for memory allocation
+    assert(s->keys != NULL && s->values != NULL && s->hashes != NULL);
+
+    if (t->engine == HT_SWISS) {
+        s->ctrl = (unsigned char *)malloc(capacity + GROUP_WIDTH - 1);
+        assert(s->ctrl != NULL);
+        memset(s->ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH - 1);
+    }
+}
+
+/*
+*  static void free_slots(slots *s):
+*
+*  Frees the arrays of a slot set and marks it as having no slots.
+*
+*  @param s: The slot set to be freed.
+*/
+static void free_slots(slots *s){
+
+    free(s->keys);
+    free(s->values);
+    free(s->hashes);
+    free(s->ctrl);
+
+    s->capacity = 0;
+    s->keys = NULL;
+    s->values = NULL;
+    s->hashes = NULL;
+    s->ctrl = NULL;
+}
+
+/*
+*  static unsigned char tag(size_t code):
+*
+*  @param code: A hash code.
+*  @return: Returns the 7-bit control byte for an entry with this code.
+*  The code is mixed first, since client hashes of short keys often
+*  leave their high bits zero.
+*/
+static unsigned char tag(size_t code){
+    return (unsigned char)(((uint64_t)code * 0x9E3779B97F4A7C15ull) >> 57);
+}
+
+/*
+*  static void set_ctrl(slots *s, size_t index, unsigned char byte):
+*
+*  Sets the control byte of a slot (and its mirror), if s has them.
+*
+*  @param s: The slot set.
+*  @param index: The slot.
+*  @param byte: The new control byte.
+*/
+static void set_ctrl(slots *s, size_t index, unsigned char byte){
+
+    if (s->ctrl == NULL) {
+        return;
+    }
+
+    s->ctrl[index] = byte;
+    if (index < GROUP_WIDTH - 1) {
+        s->ctrl[s->capacity + index] = byte;
+    }
+}
+
+/*
+*  static void store(slots *s, size_t index, void *key, void *value, size_t code):
+*
+*  Writes an entry into a slot, keeping its control byte in step.
+*
+*  @param s: The slot set.
+*  @param index: The slot.
+*  @param key: The key of the entry.
+*  @param value: The value of the entry.
+*  @param code: The cached hash code of key.
+*/
+static void store(slots *s, size_t index, void *key, void *value, size_t code){
+
+    s->keys[index] = key;
+    s->values[index] = value;
+    s->hashes[index] = code;
+    set_ctrl(s, index, tag(code));
+}
+
+/*
+*  static void vacate(slots *s, size_t index, void *marker):
+*
+*  Empties a slot (marker NULL) or marks it as migrated (marker MOVED).
+*
+*  @param s: The slot set.
+*  @param index: The slot.
+*  @param marker: NULL or MOVED.
+*/
+static void vacate(slots *s, size_t index, void *marker){
+
+    s->keys[index] = marker;
+    if (marker == NULL) {
+        s->values[index] = NULL;
+    }
+    set_ctrl(s, index, marker == NULL ? CTRL_EMPTY : CTRL_MOVED);
+}
+
+/*
+*  static unsigned group_match(const unsigned char *ctrl, unsigned char byte):
+*
+*  Compares GROUP_WIDTH consecutive control bytes against byte, with one
+*  SSE2 compare where available and a scalar loop otherwise.
+*
+*  @param ctrl: The first control byte of the group.
+*  @param byte: The control byte to look for.
+*  @return: Returns a mask with bit i set if ctrl[i] equals byte.
+*/
+static unsigned group_match(const unsigned char *ctrl, unsigned char byte){
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < GROUP_WIDTH; ++i) {
+        mask |= (unsigned)(ctrl[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+/*
+*  static bool migrating(const HashADT t):
+*
+*  @param t: The Hash Table instance.
+*  @return: Returns true while an incremental resize is in progress.
+*/
+static bool migrating(const HashADT t){
+    return t->old.keys != NULL;
+}
+
+/*
+*  static size_t distance(const slots *s, size_t index, size_t code):
+*
+*  @param s: The slot set.
+*  @param index: A slot of s.
+*  @param code: The hash code of an entry stored (or to be stored) at index.
+*  @return: Returns how many slots past its home slot index lies for the entry.
+*/
+static size_t distance(const slots *s, size_t index, size_t code){
+    return (index + s->capacity - code % s->capacity) % s->capacity;
+}
+
+/*
+*  static size_t capacity_for(size_t entries, float load_threshold):
+*
+*  @param entries: The number of entries the table must hold.
+*  @param load_threshold: The load at which the table grows.
+*  @return: Returns the smallest capacity in the table's growth sequence
+*  (INITIAL_CAPACITY times a power of RESIZE_FACTOR) that holds entries
+*  without growing.
+*/
+static size_t capacity_for(size_t entries, float load_threshold){
+
+    size_t capacity = INITIAL_CAPACITY;
+    while ((float)entries / capacity > load_threshold) {
+        capacity *= RESIZE_FACTOR;
+    }
+
+    return capacity;
+}
+
 /*
 *  HashADT ht_create:
 *  creates a new table
@@ -57,6 +307,28 @@ HashADT ht_create(
     bool (*equals)(const void *key1, const void *key2),
     void (*print)(const void *key, const void *value),
     void (*delete)(void *key, void *value)
+){
+    return ht_create_with_capacity(hash, equals, print, delete, 0);
+}
+
+/*
+*  HashADT ht_create_with_capacity:
+*  creates a new table sized to hold a number of entries without growing
+*
+*  @param hash: A function pointer to the hash function that hashes keys.
+*  @param equals: A function pointer to the comparison function that checks equality between keys.
+*  @param print: A function pointer to the function that prints key-value pairs.
+*  @param delete: A function pointer to the function that deletes key-value pairs.
+*  @param entries: The number of entries to reserve room for.
+*
+*  Returns a HashADT.
+*/
+HashADT ht_create_with_capacity(
+    size_t (*hash)(const void *key),
+    bool (*equals)(const void *key1, const void *key2),
+    void (*print)(const void *key, const void *value),
+    void (*delete)(void *key, void *value),
+    size_t entries
 ){
     assert(hash != NULL && equals != NULL && print != NULL);
 
@@ -70,19 +342,23 @@ HashADT ht_create(
     new_table->equals = equals;
     new_table->print = print;
     new_table->delete = delete;
-    new_table->capacity = INITIAL_CAPACITY;
     new_table->size = 0;
     new_table->load_threshold = LOAD_THRESHOLD;
     new_table->resize_factor = RESIZE_FACTOR;
     new_table->collisions = 0;
     new_table->rehashes = 0;
+    new_table->shrink = false;
+    new_table->min_capacity = capacity_for(entries, LOAD_THRESHOLD);
+    new_table->engine = HT_LINEAR_PROBING;
 
     // Allocate memory for keys and values arrays
-    new_table->keys = (void **)calloc(new_table->capacity, sizeof(void *));
-    new_table->values = (void **)calloc(new_table->capacity, sizeof(void *));
+    alloc_slots(new_table, &new_table->cur, new_table->min_capacity);
 
-    // Exception handling for memory allocation
-    assert(new_table->keys != NULL && new_table->values != NULL);
+    // No resize is in progress
+    new_table->old = (slots){ 0, NULL, NULL, NULL, NULL };
+    new_table->old_size = 0;
+    new_table->migrate_pos = 0;
+    new_table->migrate_step = 0;
 
     return new_table;
 }
@@ -94,7 +370,8 @@ HashADT ht_create(
 *  Destroys the HashADT structure and frees the allocated memory.
 *  Checks if the provided HashADT 't' is NULL. If true, returns without performing any action.
 *  If 'delete' function pointer within 't' is not NULL, iterates through 
-*  the capacity of the HashADT and deletes each key-value pair.
+*  the capacity of the HashADT and deletes each key-value pair, including
+*  pairs still waiting in the old arrays of an unfinished resize.
 *  Frees the memory allocated for the keys and values arrays within 't'.
 *  Frees the memory allocated for the HashADT structure 't'.
 *
@@ -107,50 +384,413 @@ void ht_destroy(HashADT t){
     }
 
    if (t->delete != NULL) {
-        for (size_t i = 0; i < t->capacity; ++i) {
-            if (t->keys[i] != NULL && t->values[i] != NULL) {
-                t->delete(t->keys[i], t->values[i]);
+        for (size_t i = 0; i < t->cur.capacity; ++i) {
+            if (t->cur.keys[i] != NULL && t->cur.values[i] != NULL) {
+                t->delete(t->cur.keys[i], t->cur.values[i]);
+            }
+        }
+        for (size_t i = 0; i < t->old.capacity; ++i) {
+            if (t->old.keys[i] != NULL && t->old.keys[i] != MOVED && t->old.values[i] != NULL) {
+                t->delete(t->old.keys[i], t->old.values[i]);
             }
         }
     }
-    free(t->keys);
-    free(t->values);
+    free_slots(&t->cur);
+    free_slots(&t->old);
 
     free(t);
 
 }
 
+/*
+*  struct ht_clear: 
+*
+*  Removes every entry, calling the delete function on each pair as
+*  ht_destroy does, and starts over with empty arrays of the reserved
+*  capacity.  The table's settings and counters are kept.
+*  
+*  @param t: The Hash Table instance to be emptied.
+*/
+void ht_clear(HashADT t){
+
+    if (t == NULL) {
+        return;
+    }
+
+    if (t->delete != NULL) {
+        HashIter it;
+        void *key;
+        void *value;
+
+        ht_iter_begin(t, &it);
+        while (ht_iter_next(&it, &key, &value)) {
+            if (value != NULL) {
+                t->delete(key, value);
+            }
+        }
+    }
+
+    free_slots(&t->cur);
+    free_slots(&t->old);
+    t->old_size = 0;
+    t->migrate_pos = 0;
+    t->size = 0;
+
+    alloc_slots(t, &t->cur, t->min_capacity);
+}
+
 /*
 *  struct void ht_dump(const HashADT t, bool contents): 
 *
 *  This function, ht_dump, prints information about the hash table 't'. 
 *  It displays the size, capacity, collisions, 
-*  and rehashes. If 'contents' is true, it also prints the contents of 
+*  and rehashes, and the progress of an incremental resize if one is
+*  under way. If 'contents' is true, it also prints the contents of
 *  the hash table, including non-empty buckets 
 *  along with their respective keys and values.
 *  
 *  @t: A pointer to the hash table to be dumped.
 *  @contents: A boolean flag indicating whether to display the contents of the hash table.
+*  @out: The stream to print to.
 */
-void ht_dump(const HashADT t, bool contents){
+void ht_dump(const HashADT t, bool contents, FILE *out){
     if (t == NULL) {
-        printf("The hash table is NULL.\n");
+        fprintf(out, "The hash table is NULL.\n");
         return;
     }
 
-    printf("Hash Table Information:\n");
-    printf("Size: %zu, Capacity: %zu, Collisions: %zu, Rehashes: %zu\n", t->size, t->capacity, t->collisions, t->rehashes);
+    // Probe length of an entry: slots examined by a successful lookup
+    size_t max_probe = 0;
+    size_t total_probe = 0;
+    size_t entries = 0;
+    for (size_t i = 0; i < t->cur.capacity; ++i) {
+        if (t->cur.keys[i] != NULL) {
+            size_t probe = distance(&t->cur, i, t->cur.hashes[i]) + 1;
+            max_probe = probe > max_probe ? probe : max_probe;
+            total_probe += probe;
+            entries++;
+        }
+    }
+
+    fprintf(out, "Hash Table Information:\n");
+    fprintf(out, "Size: %zu, Capacity: %zu, Collisions: %zu, Rehashes: %zu, Max probe: %zu, Mean probe: %.2f\n",
+            t->size, t->cur.capacity, t->collisions, t->rehashes,
+            max_probe, entries > 0 ? (double)total_probe / entries : 0.0);
+
+    if (migrating(t)) {
+        fprintf(out, "Migrating: %zu of %zu old buckets moved, %zu entries remaining\n",
+                t->migrate_pos, t->old.capacity, t->old_size);
+    }
 
     if (contents) {
-        printf("Hash Table Contents:\n");
-        for (size_t i = 0; i < t->capacity; ++i) {
-            if (t->keys[i] != NULL) {
-                printf("Bucket %zu: ", i);
-                t->print(t->keys[i], t->values[i]);
-                printf("\n");
+        fprintf(out, "Hash Table Contents:\n");
+        for (size_t i = 0; i < t->cur.capacity; ++i) {
+            if (t->cur.keys[i] != NULL) {
+                fprintf(out, "Bucket %zu: ", i);
+                t->print(t->cur.keys[i], t->cur.values[i]);
+                fprintf(out, "\n");
+            }
+        }
+        for (size_t i = t->migrate_pos; i < t->old.capacity; ++i) {
+            if (t->old.keys[i] != NULL && t->old.keys[i] != MOVED) {
+                fprintf(out, "Old bucket %zu: ", i);
+                t->print(t->old.keys[i], t->old.values[i]);
+                fprintf(out, "\n");
+            }
+        }
+    }
+}
+
+/*
+*  static bool locate_group(const HashADT t, const slots *s, const void *key, size_t code, size_t *index):
+*
+*  The HT_SWISS form of locate(): the probe chain is the same linear run
+*  from the home slot, but it is scanned GROUP_WIDTH slots at a time.
+*  Only slots whose control byte carries the key's 7-bit tag, and which
+*  come before the first empty slot of the group, are compared further.
+*
+*  @param t: The Hash Table instance.
+*  @param s: The slot set to be searched.
+*  @param key: The key to be located.
+*  @param code: The hash code of key.
+*  @param index: Out parameter receiving the key's slot or the insertion slot.
+*  @return: Returns true if the key is in the slot set, otherwise false.
+*/
+static bool locate_group(const HashADT t, const slots *s, const void *key, size_t code, size_t *index){
+
+    size_t i = code % s->capacity;
+    unsigned char byte = tag(code);
+
+    for (;;) {
+        unsigned match = group_match(s->ctrl + i, byte);
+        unsigned empty = group_match(s->ctrl + i, CTRL_EMPTY);
+
+        if (empty != 0) {
+            match &= (empty & -empty) - 1; // the chain ends at the first empty slot
+        }
+
+        while (match != 0) {
+            size_t j = (i + (size_t)__builtin_ctz(match)) % s->capacity;
+            if (s->hashes[j] == code && t->equals(s->keys[j], key)) {
+                *index = j;
+                return true;
+            }
+            match &= match - 1;
+        }
+
+        if (empty != 0) {
+            *index = (i + (size_t)__builtin_ctz(empty)) % s->capacity;
+            return false;
+        }
+
+        i = (i + GROUP_WIDTH) % s->capacity;
+    }
+}
+
+/*
+*  static bool locate(const HashADT t, const slots *s, const void *key, size_t code, size_t *index):
+*
+*  Walks the probe chain for key in one slot set exactly once.  On
+*  success, index is set to the slot holding the key; otherwise it is set
+*  to the empty slot that ends the chain, which is where the key would be
+*  inserted.  Every lookup, insertion and removal goes through this one
+*  walk.  Slots whose cached hash code differs from code are rejected
+*  without touching the stored key, and migrated slots are stepped over.
+*
+*  With the Robin Hood engine the walk also stops at the first entry
+*  that sits closer to its home slot than the key would, since the key
+*  would have displaced that entry on insertion.  index is then the
+*  slot where insert_from() has to place the key.
+*
+*  @param t: The Hash Table instance.
+*  @param s: The slot set to be searched.
+*  @param key: The key to be located.
+*  @param code: The hash code of key.
+*  @param index: Out parameter receiving the key's slot or the insertion slot.
+*  @return: Returns true if the key is in the slot set, otherwise false.
+*/
+static bool locate(const HashADT t, const slots *s, const void *key, size_t code, size_t *index){
+
+    if (s->ctrl != NULL) {
+        return locate_group(t, s, key, code, index);
+    }
+
+    size_t i = code % s->capacity;
+    size_t dist = 0;
+
+    while (s->keys[i] != NULL) {
+        if (s->hashes[i] == code && s->keys[i] != MOVED && t->equals(s->keys[i], key)) {
+            *index = i;
+            return true; 
+        }
+        if (t->engine == HT_ROBIN_HOOD && distance(s, i, s->hashes[i]) < dist) {
+            break;
+        }
+        i = (i + 1) % s->capacity; // Handle collisions 
+        dist++;
+    }
+
+    *index = i;
+    return false;
+}
+
+/*
+*  static size_t insert_from(HashADT t, slots *s, size_t index, void *key, void *value, size_t code):
+*
+*  Stores an entry known not to be in the slot set, starting at index,
+*  which must lie on the entry's probe chain at or before its final slot.
+*  Linear probing stores it at the first empty slot.  Robin Hood probing
+*  swaps it with the first entry that is closer to its own home slot and
+*  carries the displaced entry onward the same way, which keeps probe
+*  lengths even.  Each occupied slot passed over counts as a collision.
+*
+*  @param t: The Hash Table instance.
+*  @param s: The slot set receiving the entry.
+*  @param index: The slot to start from.
+*  @param key: The key of the entry.
+*  @param value: The value of the entry.
+*  @param code: The cached hash code of key.
+*  @return: Returns the slot the entry was stored in.
+*/
+static size_t insert_from(HashADT t, slots *s, size_t index, void *key, void *value, size_t code){
+
+    size_t stored = SIZE_MAX;
+    size_t dist = distance(s, index, code);
+
+    while (s->keys[index] != NULL) {
+        if (t->engine == HT_ROBIN_HOOD) {
+            size_t resident = distance(s, index, s->hashes[index]);
+            if (resident < dist) {
+                void *k = s->keys[index];
+                void *v = s->values[index];
+                size_t c = s->hashes[index];
+                store(s, index, key, value, code);
+                key = k;
+                value = v;
+                code = c;
+                dist = resident;
+                if (stored == SIZE_MAX) {
+                    stored = index;
+                }
             }
         }
+        index = (index + 1) % s->capacity; // Handle collisions in the new table
+        dist++;
+        t->collisions ++;
+    }
+    store(s, index, key, value, code);
+
+    return stored == SIZE_MAX ? index : stored;
+}
+
+/*
+*  static size_t place(HashADT t, slots *s, void *key, void *value, size_t code):
+*
+*  Stores an entry known not to be in the slot set, starting from its
+*  home slot.
+*
+*  @param t: The Hash Table instance.
+*  @param s: The slot set receiving the entry.
+*  @param key: The key of the entry.
+*  @param value: The value of the entry.
+*  @param code: The cached hash code of key.
+*  @return: Returns the slot the entry was stored in.
+*/
+static size_t place(HashADT t, slots *s, void *key, void *value, size_t code){
+    return insert_from(t, s, code % s->capacity, key, value, code);
+}
+
+/*
+*  static void migrate(HashADT t, size_t budget):
+*
+*  Moves the live entries of up to budget old slots, starting at
+*  migrate_pos, into the current arrays by their cached hash codes.
+*  Moved slots are marked so lookups in the old arrays skip them; once
+*  every old slot has been visited the old arrays are freed.
+*
+*  @param t: The Hash Table instance.
+*  @param budget: The maximum number of old slots to visit.
+*/
+static void migrate(HashADT t, size_t budget){
+
+    while (migrating(t) && budget > 0) {
+
+        size_t i = t->migrate_pos;
+        if (t->old.keys[i] != NULL && t->old.keys[i] != MOVED) {
+            place(t, &t->cur, t->old.keys[i], t->old.values[i], t->old.hashes[i]);
+            vacate(&t->old, i, MOVED);
+            t->old_size--;
+            t->rehashes ++;
+        }
+
+        t->migrate_pos++;
+        budget--;
+
+        if (t->migrate_pos == t->old.capacity) {
+            free_slots(&t->old);
+            t->migrate_pos = 0;
+        }
+    }
+}
+
+/*
+*  static void rehash(HashADT t, size_t new_capacity):
+*
+*  Replaces the current arrays with freshly allocated arrays of
+*  new_capacity slots.  Any unfinished resize is completed first.  The
+*  previous arrays become the old arrays, whose entries are moved over
+*  all at once, or migrate_step slots per operation when incremental
+*  resizing is enabled.  Used both to grow the table in ht_put and to
+*  shrink it in ht_remove.
+*
+*  @param t: The Hash Table instance to be rehashed.
+*  @param new_capacity: The number of slots in the rebuilt table.
+*/
+static void rehash(HashADT t, size_t new_capacity){
+
+    migrate(t, SIZE_MAX);
+
+    t->old = t->cur;
+    t->old_size = t->size;
+    t->migrate_pos = 0;
+
+    alloc_slots(t, &t->cur, new_capacity);
+
+    if (t->migrate_step == 0) {
+        migrate(t, SIZE_MAX);
+    }
+}
+
+/*
+*  static bool find(const HashADT t, const void *key, size_t code, slots **s, size_t *index):
+*
+*  Locates a key in the current arrays, and then in the old arrays if a
+*  resize is in progress.  On success, s and index identify the slot
+*  holding the key.  On failure, index is the insertion slot in the
+*  current arrays.
+*
+*  @param t: The Hash Table instance.
+*  @param key: The key to be located.
+*  @param code: The hash code of key.
+*  @param s: Out parameter receiving the slot set holding the key.
+*  @param index: Out parameter receiving the key's slot or the insertion slot.
+*  @return: Returns true if the key is in the table, otherwise false.
+*/
+static bool find(const HashADT t, const void *key, size_t code, slots **s, size_t *index){
+
+    *s = &t->cur;
+    if (locate(t, &t->cur, key, code, index)) {
+        return true;
+    }
+
+    size_t old_index;
+    if (migrating(t) && locate(t, &t->old, key, code, &old_index)) {
+        *s = &t->old;
+        *index = old_index;
+        return true;
+    }
+
+    return false; 
+}
+
+/*
+*  struct ht_dump_page: 
+*
+*  Prints one page of the table's contents: up to count non-empty 
+*  buckets, starting at bucket start, each through the registered print
+*  function as it is reached.  Any incremental resize in progress is
+*  finished first so bucket numbers stay meaningful between pages.
+*  
+*  @param t: The Hash Table instance to be dumped.
+*  @param start: The first bucket to look at.
+*  @param count: The maximum number of entries to print.
+*  @param out: The stream to print to.
+*  @return: Returns the bucket the next page starts at, or 0 once every
+*  entry from start onwards has been printed.
+*/
+size_t ht_dump_page(const HashADT t, size_t start, size_t count, FILE *out){
+
+    if (t == NULL) {
+        return 0;
+    }
+
+    migrate(t, SIZE_MAX);
+
+    size_t i = start;
+    for (size_t printed = 0; i < t->cur.capacity && printed < count; ++i) {
+        if (t->cur.keys[i] != NULL) {
+            fprintf(out, "Bucket %zu: ", i);
+            t->print(t->cur.keys[i], t->cur.values[i]);
+            fprintf(out, "\n");
+            printed++;
+        }
     }
+
+    while (i < t->cur.capacity && t->cur.keys[i] == NULL) {
+        ++i;
+    }
+
+    return i < t->cur.capacity ? i : 0;
 }
 
 /*
@@ -166,19 +806,32 @@ void ht_dump(const HashADT t, bool contents){
 *  if the key is not found or the table is NULL.
 */
 const void *ht_get(const HashADT t, const void *key){
+    return ht_find(t, key);
+}
+
+/*
+*  struct ht_find: 
+*
+*  Retrieves the value associated with the given key in a single walk
+*  of the probe chain.  Advances an incremental resize by one step.
+*  
+*  @param t: The Hash Table instance.
+*  @param key: The key whose associated value needs to be retrieved.
+*  @return: Returns the associated value for the given key or NULL 
+*  if the key is not found or the table is NULL.
+*/
+void *ht_find(const HashADT t, const void *key){
 
     if (t == NULL || key == NULL) {
         return NULL;
     }
 
-    if (ht_has(t, key)) {
-        size_t index = t->hash(key) % t->capacity; 
-        while (t->keys[index] != NULL) {
-            if (t->equals(t->keys[index], key)) {
-                return t->values[index]; 
-            }
-            index = (index + 1) % t->capacity; // Handle collisions 
-        }
+    migrate(t, t->migrate_step);
+
+    slots *s;
+    size_t index;
+    if (find(t, key, t->hash(key), &s, &index)) {
+        return s->values[index];
     }
 
     return NULL; 
@@ -201,16 +854,68 @@ bool ht_has(const HashADT t, const void *key){
         return false;
     }
 
-    size_t index = t->hash(key) % t->capacity; 
+    slots *s;
+    size_t index;
+    return find(t, key, t->hash(key), &s, &index);
+}
 
-    while (t->keys[index] != NULL) {
-        if (t->equals(t->keys[index], key)) {
-            return true; 
+/*
+*  struct ht_get_or_insert: 
+*
+*  Finds the slot for a key, inserting the key with a NULL value if it
+*  is not yet in the table.  Growth happens before the key is placed,
+*  so the returned slot stays valid until the next call that modifies
+*  the table.  A newly inserted slot must be filled in by the caller;
+*  the key pointer may be replaced by an equal key the table should own.
+*  A key found in the old arrays of a resize is moved to the current
+*  arrays first, so the slot returned is always a current one.
+*  
+*  @param t: The Hash Table instance.
+*  @param key: The key to be found or inserted.
+*  @param inserted: Out parameter set to true if the key was inserted (may be NULL).
+*  @return: Returns the slot holding the key and its value, or a slot of
+*  NULL pointers if the table or key is NULL.
+*/
+HashSlot ht_get_or_insert(HashADT t, const void *key, bool *inserted){
+
+    HashSlot slot = { NULL, NULL };
+    if (inserted != NULL) {
+        *inserted = false;
+    }
+
+    if (t == NULL || key == NULL) {
+        return slot;
+    }
+
+    migrate(t, t->migrate_step);
+
+    size_t code = t->hash(key);
+    slots *s;
+    size_t index;
+    if (find(t, key, code, &s, &index)) {
+        if (s == &t->old) {
+            size_t old_index = index;
+            index = place(t, &t->cur, s->keys[old_index], s->values[old_index], code);
+            vacate(s, old_index, MOVED);
+            t->old_size--;
+        }
+    } else {
+        if ((float)(t->size + 1) / t->cur.capacity > t->load_threshold) {
+            rehash(t, t->cur.capacity * RESIZE_FACTOR);
+            locate(t, &t->cur, key, code, &index);
+        }
+
+        index = insert_from(t, &t->cur, index, (void *)key, NULL, code);
+        t->size++; 
+
+        if (inserted != NULL) {
+            *inserted = true;
         }
-        index = (index + 1) % t->capacity; // Handle collisions 
     }
 
-    return false; 
+    slot.key = &t->cur.keys[index];
+    slot.value = &t->cur.values[index];
+    return slot;
 }
 
 /*
@@ -231,57 +936,322 @@ void *ht_put(HashADT t, const void *key, const void *value){
         return NULL;
     }
 
-    size_t index = t->hash(key) % t->capacity; 
-    void *old_value = NULL;
+    HashSlot slot = ht_get_or_insert(t, key, NULL);
+    void *old_value = *slot.value;
+    *slot.value = (void *)value;
 
-    // Find the index for the key
-    while (t->keys[index] != NULL) {
-        if (t->equals(t->keys[index], key)) {
-            old_value = t->values[index];
-            t->values[index] = (void *)value;
-            return old_value; 
+    return old_value; 
+}
+
+/*
+*  struct ht_remove: 
+*
+*  Removes a key and its value from the Hash Table using backward-shift
+*  deletion: after the slot is emptied, every later entry of the same
+*  probe run whose home slot is not between the hole and its current
+*  position is moved back into the hole.  Under Robin Hood probing the
+*  run is shifted back one slot up to the first entry that is already
+*  in its home slot, which keeps the run ordered.  This keeps every remaining key
+*  reachable from its home slot without leaving tombstones behind, so
+*  probe lengths do not degrade as entries come and go.  A key still
+*  waiting in the old arrays of a resize is simply marked as moved,
+*  since those arrays only ever drain.
+*  If shrinking is enabled and the load falls below SHRINK_THRESHOLD,
+*  the table is rehashed into a smaller one, though never below the
+*  capacity the client reserved.
+*  
+*  @param t: The Hash Table instance from which the key will be removed.
+*  @param key: The key to be removed from the table.
+*  @return: Returns the value that was associated with the key, or NULL
+*  if the key was not found or the table is NULL.
+*/
+void *ht_remove(HashADT t, const void *key){
+
+    if (t == NULL || key == NULL) {
+        return NULL;
+    }
+
+    migrate(t, t->migrate_step);
+
+    slots *s;
+    size_t index;
+    if (!find(t, key, t->hash(key), &s, &index)) {
+        return NULL; 
+    }
+
+    void *old_value = s->values[index];
+    t->size--;
+
+    if (s == &t->old) {
+        vacate(s, index, MOVED);
+        t->old_size--;
+        return old_value;
+    }
+
+    size_t hole = index;
+
+    // Walk the rest of the run, pulling back entries that can legally
+    // occupy the hole (their home slot is not cyclically in (hole, next])
+    size_t next = (hole + 1) % s->capacity;
+    while (s->keys[next] != NULL) {
+        size_t home = s->hashes[next] % s->capacity;
+        if (t->engine == HT_ROBIN_HOOD && home == next) {
+            break;
+        }
+        bool stays = (hole <= next) ? (hole < home && home <= next)
+                                    : (hole < home || home <= next);
+        if (!stays) {
+            store(s, hole, s->keys[next], s->values[next], s->hashes[next]);
+            hole = next;
         }
-        index = (index + 1) % t->capacity; // Handle collisions 
+        next = (next + 1) % s->capacity;
     }
 
-    t->keys[index] = (void *)key;
-    t->values[index] = (void *)value;
-    t->size++; 
+    vacate(s, hole, NULL);
 
-    if ((float)t->size / t->capacity > LOAD_THRESHOLD) {
-        size_t new_capacity = t->capacity * RESIZE_FACTOR;
-        void **new_keys = calloc(new_capacity, sizeof(void *));
-        void **new_values = calloc(new_capacity, sizeof(void *));
+    if (t->shrink && !migrating(t) && t->cur.capacity > t->min_capacity &&
+            (float)t->size / t->cur.capacity < SHRINK_THRESHOLD) {
+        size_t new_capacity = t->cur.capacity / RESIZE_FACTOR;
+        rehash(t, new_capacity < t->min_capacity ? t->min_capacity : new_capacity);
+    }
 
-        // Rehashing: iterate through existing elements, recalculate hashes, and insert into the new table
-        for (size_t i = 0; i < t->capacity; i++) {
-            
-            if (t->keys[i] != NULL) {
-                size_t new_index = t->hash(t->keys[i]) % new_capacity;
-                t->rehashes ++;
+    return old_value; 
+}
 
-                while (new_keys[new_index] != NULL) {
-                    new_index = (new_index + 1) % new_capacity; // Handle collisions in the new table
-                    t->collisions ++;
-                }
-                new_keys[new_index] = t->keys[i];
-                new_values[new_index] = t->values[i];
+/*
+*  static void grow_for(HashADT t, size_t entries):
+*
+*  Grows the table, with a single rehash, to the capacity that holds
+*  entries without further growth, if it is not that large already.
+*
+*  @param t: The Hash Table instance.
+*  @param entries: The number of entries the table must hold.
+*/
+static void grow_for(HashADT t, size_t entries){
+
+    size_t capacity = capacity_for(entries, t->load_threshold);
+
+    if (capacity > t->cur.capacity) {
+        rehash(t, capacity);
+    }
+}
+
+/*
+*  struct ht_reserve: 
+*
+*  Makes room for a number of entries, so that inserting up to that
+*  many causes no further rehashing.  The reserved capacity also
+*  becomes the floor for shrinking.
+*  
+*  @param t: The Hash Table instance.
+*  @param entries: The number of entries the table must hold without growing.
+*/
+void ht_reserve(HashADT t, size_t entries){
+
+    if (t == NULL) {
+        return;
+    }
+
+    size_t capacity = capacity_for(entries, t->load_threshold);
+
+    if (capacity > t->min_capacity) {
+        t->min_capacity = capacity;
+    }
+    grow_for(t, entries);
+}
+
+/*
+*  struct ht_put_batch: 
+*
+*  Inserts or updates n key-value pairs, reserving room for all of them
+*  up front so the batch triggers at most one rehash.
+*  
+*  @param t: The Hash Table instance.
+*  @param keys: The keys to be inserted/updated.
+*  @param values: The values associated with the keys.
+*  @param n: The number of pairs.
+*  @return: Returns the number of keys that were not in the table before.
+*/
+size_t ht_put_batch(HashADT t, const void *const *keys, const void *const *values, size_t n){
+
+    if (t == NULL) {
+        return 0;
+    }
+
+    grow_for(t, t->size + n);
+
+    size_t added = 0;
+    for (size_t i = 0; i < n; ++i) {
+        bool inserted;
+        HashSlot slot = ht_get_or_insert(t, keys[i], &inserted);
+        if (slot.value != NULL) {
+            *slot.value = (void *)values[i];
+            added += inserted;
+        }
+    }
+
+    return added;
+}
+
+/*
+*  struct ht_set_shrink: 
+*
+*  Enables or disables shrinking of the table when removals drop the
+*  load below SHRINK_THRESHOLD.
+*  
+*  @param t: The Hash Table instance.
+*  @param enabled: Whether ht_remove may shrink the table.
+*/
+void ht_set_shrink(HashADT t, bool enabled){
+
+    if (t == NULL) {
+        return;
+    }
+
+    t->shrink = enabled;
+}
+
+/*
+*  struct ht_set_incremental:
+*
+*  Sets how many old slots each operation migrates during a resize.
+*  A step of 0 restores stop-the-world resizing and finishes any
+*  resize that is in progress.
+*
+*  @param t: The Hash Table instance.
+*  @param step: Old slots moved per operation, or 0 to resize all at once.
+*/
+void ht_set_incremental(HashADT t, size_t step){
+
+    if (t == NULL) {
+        return;
+    }
+
+    t->migrate_step = step;
+    if (step == 0) {
+        migrate(t, SIZE_MAX);
+    }
+}
+
+/*
+*  struct ht_set_engine: 
+*
+*  Selects the probing strategy of the table, along with the load it
+*  may reach before growing.  A table that already holds entries is
+*  rebuilt in place so they are laid out the way the new engine expects.
+*  
+*  @param t: The Hash Table instance.
+*  @param engine: The probing strategy to use from now on.
+*/
+void ht_set_engine(HashADT t, HashEngine engine){
+
+    if (t == NULL || t->engine == engine) {
+        return;
+    }
+
+    t->engine = engine;
+    t->load_threshold = engine == HT_SWISS ? SWISS_LOAD_THRESHOLD : LOAD_THRESHOLD;
+
+    size_t step = t->migrate_step;
+    t->migrate_step = 0;
+    rehash(t, t->cur.capacity);
+    t->migrate_step = step;
+}
+
+/*
+*  struct ht_iter_begin: 
+*
+*  Starts a walk over the table's entries in slot order.  Any
+*  incremental resize in progress is finished first, so the walk covers
+*  a single array and lookups made during the walk cannot move entries
+*  underneath it.
+*  
+*  @param t: The Hash Table instance to be walked.
+*  @param it: The iterator to be positioned before the first slot.
+*/
+void ht_iter_begin(const HashADT t, HashIter *it){
+
+    if (t != NULL) {
+        migrate(t, SIZE_MAX);
+    }
+
+    it->table = t;
+    it->index = 0;
+}
+
+/*
+*  struct ht_iter_next: 
+*
+*  Advances the iterator to the next occupied slot.
+*  
+*  @param it: The iterator.
+*  @param key: Out parameter receiving the entry's key (may be NULL).
+*  @param value: Out parameter receiving the entry's value (may be NULL).
+*  @return: Returns false once every entry has been visited.
+*/
+bool ht_iter_next(HashIter *it, void **key, void **value){
+
+    const HashADT t = it->table;
+    if (t == NULL) {
+        return false;
+    }
+
+    while (it->index < t->cur.capacity) {
+        size_t i = it->index++;
+        if (t->cur.keys[i] != NULL) {
+            if (key != NULL) {
+                *key = t->cur.keys[i];
+            }
+            if (value != NULL) {
+                *value = t->cur.values[i];
             }
+            return true;
         }
+    }
 
-        // Free the old table's keys and values arrays
-        free(t->keys);
-        free(t->values);
+    return false;
+}
 
-        // Update the hash table with the new values and parameters
-        t->keys = new_keys;
-        t->values = new_values;
-        t->capacity = new_capacity;
+/*
+*  struct ht_foreach: 
+*
+*  Calls visit on every (key,value) pair of the table in slot order,
+*  without allocating anything.
+*  
+*  @param t: The Hash Table instance to be walked.
+*  @param visit: The function called with each key, value and arg.
+*  @param arg: Client data passed through to visit.
+*/
+void ht_foreach(const HashADT t, void (*visit)(void *key, void *value, void *arg), void *arg){
+
+    HashIter it;
+    void *key;
+    void *value;
 
-        // Update other parameters such as load_threshold or resize_factor as necessary
+    ht_iter_begin(t, &it);
+    while (ht_iter_next(&it, &key, &value)) {
+        visit(key, value, arg);
     }
+}
 
-    return old_value; 
+/*
+*  static void collect(const HashADT t, void **out, bool want_keys):
+*
+*  Copies the keys or values of every entry into out.
+*
+*  @param t: The Hash Table instance.
+*  @param out: An array with room for t->size pointers.
+*  @param want_keys: True to copy keys, false to copy values.
+*/
+static void collect(const HashADT t, void **out, bool want_keys){
+
+    HashIter it;
+    size_t index = 0;
+
+    ht_iter_begin(t, &it);
+    while (ht_iter_next(&it, want_keys ? &out[index] : NULL, want_keys ? NULL : &out[index])) {
+        index++;
+    }
 }
 
 void **ht_keys(const HashADT t){
@@ -296,14 +1266,7 @@ void **ht_keys(const HashADT t){
         return NULL; 
     }
 
-    size_t index = 0;
-
-    for (size_t i = 0; i < t->capacity; ++i) {
-        if (t->keys[i] != NULL) {
-            keys[index] = t->keys[i];
-            index++;
-        }
-    }
+    collect(t, keys, true);
 
     return keys; 
 }
@@ -330,15 +1293,7 @@ void **ht_values(const HashADT t){
         return NULL; 
     }
 
-    size_t index = 0;
-
-    for (size_t i = 0; i < t->capacity; ++i) {
-        if (t->keys[i] != NULL) {
-            values[index] = t->values[i];
-            index++;
-        }
-    }
+    collect(t, values, false);
 
     return values; 
 }
-
@@ -8,6 +8,7 @@
 
 #include <stdbool.h>    // bool
 #include <stddef.h>     // size_t
+#include <stdio.h>      // FILE
 
 /// Initial capacity of table upon creation
 #define INITIAL_CAPACITY 16
@@ -15,9 +16,20 @@
 /// The load at which the table will rehash
 #define LOAD_THRESHOLD 0.75
 
+/// The load at which a table using the HT_SWISS engine will rehash
+#define SWISS_LOAD_THRESHOLD 0.875
+
 /// The table size will double upon each rehash
 #define RESIZE_FACTOR 2
 
+/// The load below which a table with shrinking enabled will rehash
+/// into a table RESIZE_FACTOR times smaller
+#define SHRINK_THRESHOLD 0.20
+
+/// Suggested number of old slots each operation migrates while an
+/// incremental resize is in progress (see ht_set_incremental)
+#define MIGRATE_STEP 8
+
 ///
 /// General Notes on hash table Operation
 ///
@@ -32,7 +44,10 @@
 ///   delete function, which causes the delete function to NOT free the
 ///   (key, value) pair.
 ///
-/// - There is no remove functionality. Entries remain until you call destroy.
+/// - Entries are removed with ht_remove(), which hands ownership of the
+///   (key,value) pair back to the client; the delete function is not called.
+///   Removal shifts later entries of the probe chain back, so the table
+///   never holds tombstones.
 ///
 /// - The destroy calls a no-operation delete if the client passes NULL destroy.
 ///
@@ -51,6 +66,35 @@
 ///
 typedef struct hashtab_s *HashADT;
 
+///
+/// A cursor over the entries of a table (see ht_iter_begin()).  It lives
+/// wherever the client declares it, so iteration allocates nothing.  The
+/// fields are private to the implementation.
+///
+typedef struct ht_iter_s {
+    HashADT table;  ///< the table being walked
+    size_t index;   ///< the next slot to visit
+} HashIter;
+
+///
+/// The probing strategies a table can use (see ht_set_engine()).
+///
+typedef enum ht_engine_e {
+    HT_LINEAR_PROBING,  ///< plain linear probing (the default)
+    HT_ROBIN_HOOD,      ///< linear probing with Robin Hood displacement
+    HT_SWISS            ///< linear probing scanned 16 control bytes at a time
+} HashEngine;
+
+///
+/// A reference to the key and value pointers stored in one slot of a
+/// table, as returned by ht_get_or_insert().  A slot is only valid until
+/// the next operation that modifies the table.
+///
+typedef struct ht_slot_s {
+    void **key;     ///< the stored key pointer
+    void **value;   ///< the stored value pointer
+} HashSlot;
+
 ///
 /// Create a new hash table instance.  If delete is NULL, destroying the
 /// table will NOT free the (key,value) data pairs.
@@ -73,6 +117,31 @@ HashADT ht_create(
     void (*delete)( void *key, void *value )
 );
 
+///
+/// Create a new hash table instance with room for a number of entries,
+/// so that inserting up to that many causes no rehashing.  Otherwise
+/// identical to ht_create().
+///
+/// @param hash The hash function for key data
+/// @param equals The equal function for key comparison
+/// @param print The print function for key, value pairs is used by dump().
+/// @param delete The delete function for key, value pairs is used by destroy().
+/// @param entries The number of entries to reserve room for
+/// 
+/// @exception Assert fails if it cannot allocate space
+/// 
+/// @pre hash, equals and print are valid function pointers.
+/// 
+/// @return A newly created table
+///
+HashADT ht_create_with_capacity(
+    size_t (*hash)( const void *key ),
+    bool (*equals)( const void *key1, const void *key2 ),
+    void (*print)( const void *key, const void *value ),
+    void (*delete)( void *key, void *value ),
+    size_t entries
+);
+
 ///
 /// Destroy the table instance, and call delete function on (key,value) pair.
 /// 
@@ -85,17 +154,55 @@ HashADT ht_create(
 void ht_destroy( HashADT t );
 
 ///
-/// Print information about hash table (size, capacity, collisions, rehashes). 
+/// Remove every (key,value) pair from the table, calling the delete
+/// function on each pair as ht_destroy() does (nothing is freed if the
+/// delete function is NULL).  The table stays valid, keeps its settings,
+/// and shrinks back to its reserved capacity.
+/// 
+/// @param t The table to empty
+/// 
+/// @exception Assert fails if it cannot allocate space
+/// 
+/// @pre t is a valid instance of table.
+/// 
+/// @post t is empty.
+///
+void ht_clear( HashADT t );
+
+///
+/// Print information about hash table (size, capacity, collisions, rehashes,
+/// maximum and mean probe length), and the progress of an incremental
+/// resize if one is under way.
 /// 
 /// If contents is true, also print the entire contents of the hash table
-/// using the registered print function with each non-null entry.
+/// using the registered print function with each non-null entry.  The
+/// print function is expected to write to the same stream.
 /// 
 /// @param t The table to display
 /// @param contents Do a full dump including the entire table contents
+/// @param out The stream to print to
 /// 
 /// @pre t is a valid instance of table.
 ///
-void ht_dump( const HashADT t, bool contents );
+void ht_dump( const HashADT t, bool contents, FILE *out );
+
+///
+/// Print one page of the table's contents: up to count non-empty buckets,
+/// starting at bucket start, using the registered print function.  Each
+/// entry is printed as it is reached, so nothing is buffered.  Any
+/// incremental resize in progress is finished first.
+/// 
+/// @param t The table to display
+/// @param start The first bucket to look at
+/// @param count The maximum number of entries to print
+/// @param out The stream to print to, as for ht_dump()
+/// 
+/// @pre t is a valid instance of table.
+/// 
+/// @return The bucket the next page starts at, or 0 once every entry
+///         from start onwards has been printed
+///
+size_t ht_dump_page( const HashADT t, size_t start, size_t count, FILE *out );
 
 ///
 /// Get the value associated with a key from the table.  This function
@@ -113,6 +220,19 @@ void ht_dump( const HashADT t, bool contents );
 ///
 const void *ht_get( const HashADT t, const void *key );
 
+///
+/// Find the value associated with a key in a single walk of the probe
+/// chain.  Unlike ht_get(), a missing key is not a precondition violation.
+/// 
+/// @param t The table
+/// @param key The key
+/// 
+/// @pre t is a valid instance of table, and key is not NULL.
+/// 
+/// @return The value associated with the key, or NULL if there is none
+///
+void *ht_find( const HashADT t, const void *key );
+
 ///
 /// Check if the table has a key.  This function uses the registered hash
 /// function to locate the key, and the registered equals function to
@@ -146,6 +266,131 @@ bool ht_has( const HashADT t, const void *key );
 ///
 void *ht_put( HashADT t, const void *key, const void *value );
 
+///
+/// Find the slot holding a key, inserting the key with a NULL value if
+/// it is not in the table yet, in a single walk of the probe chain.  The
+/// table grows before the key is placed, so the slot stays valid until
+/// the next operation that modifies the table.
+/// 
+/// When a key is inserted, the client must store a value through the
+/// slot, and may replace the key pointer with an equal key (one with the
+/// same hash) that the table should own from then on.
+/// 
+/// @param t The table
+/// @param key The key
+/// @param inserted If not NULL, set to whether the key was inserted
+/// 
+/// @exception Assert fails if it cannot allocate space
+/// 
+/// @pre t is a valid instance of table, and key is not NULL.
+/// 
+/// @return The slot holding the key and its value
+///
+HashSlot ht_get_or_insert( HashADT t, const void *key, bool *inserted );
+
+///
+/// Remove a key and its value from the table.  This function uses the
+/// registered hash function to locate the key, and the registered equals
+/// function to check for equality.  The delete function is NOT called;
+/// the client takes back ownership of the stored key and value.
+/// 
+/// @param t The table
+/// @param key The key
+/// 
+/// @pre t is a valid instance of table, and key is not NULL.
+/// 
+/// @post if shrinking is enabled and size fell below SHRINK_THRESHOLD,
+///       table has shrunk by RESIZE_FACTOR (never below the reserved capacity).
+/// 
+/// @return The value that was associated with the key, or NULL if the
+///         key was not in the table.
+///
+void *ht_remove( HashADT t, const void *key );
+
+///
+/// Make room for a number of entries, growing the table at most once, so
+/// that inserting up to that many entries causes no further rehashing.
+/// The reserved capacity is also the floor below which the table never
+/// shrinks.
+/// 
+/// @param t The table
+/// @param entries The number of entries the table must hold without growing
+/// 
+/// @exception Assert fails if it cannot allocate space
+/// 
+/// @pre t is a valid instance of table.
+///
+void ht_reserve( HashADT t, size_t entries );
+
+///
+/// Add or update n key value pairs, as n calls to ht_put() would, after
+/// reserving room for all of them so the batch rehashes at most once.
+/// 
+/// @param t The table
+/// @param keys The keys
+/// @param values The values, values[i] going with keys[i]
+/// @param n The number of pairs
+/// 
+/// @exception Assert fails if it cannot allocate space
+/// 
+/// @pre t is a valid instance of table, and no key is NULL.
+/// 
+/// @return The number of keys that were not already in the table
+///
+size_t ht_put_batch( HashADT t, const void *const *keys,
+                     const void *const *values, size_t n );
+
+///
+/// Enable or disable shrinking of the table on low load.  Shrinking is
+/// disabled by default, so a table keeps the capacity it has grown to.
+/// A shrinking table never drops below the capacity reserved by
+/// ht_create_with_capacity() or ht_reserve().
+/// 
+/// @param t The table
+/// @param enabled Whether ht_remove may shrink the table
+/// 
+/// @pre t is a valid instance of table.
+///
+void ht_set_shrink( HashADT t, bool enabled );
+
+///
+/// Choose between stop-the-world and incremental resizing.  By default
+/// (step 0) a resize moves every entry into the new arrays at once.
+/// With a non-zero step, a resize only allocates the new arrays; the old
+/// ones are kept alongside them and every later ht_get, ht_find,
+/// ht_put, ht_get_or_insert or ht_remove moves step more old slots over,
+/// which bounds the work done by any single operation.  ht_dump reports
+/// the progress of a migration.  Setting step to 0 finishes any
+/// migration in progress.
+/// 
+/// @param t The table
+/// @param step Number of old slots moved per operation, or 0
+/// 
+/// @pre t is a valid instance of table.
+///
+void ht_set_incremental( HashADT t, size_t step );
+
+///
+/// Select the probing strategy of the table.  Both engines probe
+/// linearly from a key's home slot.  HT_ROBIN_HOOD additionally lets an
+/// inserted key take the slot of any entry closer to its own home slot
+/// (moving that entry on), which evens out probe lengths; lookups for a
+/// missing key stop as soon as they pass such an entry.  HT_SWISS keeps
+/// one control byte per slot (empty, or 7 bits of the key's hash) and
+/// scans them 16 at a time, with SSE2 where the compiler targets it, so
+/// only slots with a matching tag are ever compared; it grows at
+/// SWISS_LOAD_THRESHOLD rather than LOAD_THRESHOLD.  A table that
+/// already holds entries is rebuilt for the new engine.
+/// 
+/// @param t The table
+/// @param engine The probing strategy
+/// 
+/// @exception Assert fails if it cannot allocate space
+/// 
+/// @pre t is a valid instance of table.
+///
+void ht_set_engine( HashADT t, HashEngine engine );
+
 ///
 /// Get the collection of keys from the table.  This function allocates
 /// space to store the keys, which the caller is responsible for freeing.
@@ -178,4 +423,43 @@ void **ht_keys( const HashADT t );
 ///
 void **ht_values( const HashADT t );
 
+///
+/// Start a walk over the (key,value) pairs of the table.  Pairs come back
+/// in slot order, which is the order they sit in memory.  Any incremental
+/// resize in progress is finished first, so lookups are allowed during
+/// the walk; the table must not otherwise be modified until it ends.
+/// 
+/// @param t The table
+/// @param it The iterator to be positioned before the first pair
+/// 
+/// @pre t is a valid instance of table, and it is not NULL.
+///
+void ht_iter_begin( const HashADT t, HashIter *it );
+
+///
+/// Advance an iterator to the next (key,value) pair.
+/// 
+/// @param it An iterator started by ht_iter_begin()
+/// @param key If not NULL, receives the key of the pair
+/// @param value If not NULL, receives the value of the pair
+/// 
+/// @return true if a pair was produced, false once the walk is over
+///
+bool ht_iter_next( HashIter *it, void **key, void **value );
+
+///
+/// Call a function on every (key,value) pair of the table, in slot order,
+/// without allocating anything.  The same rules as for ht_iter_begin()
+/// apply to modifying the table during the walk.
+/// 
+/// @param t The table
+/// @param visit The function called with each key, value and arg
+/// @param arg Client data handed to every call of visit
+/// 
+/// @pre t is a valid instance of table, and visit is a valid function pointer.
+///
+void ht_foreach( const HashADT t,
+                 void (*visit)( void *key, void *value, void *arg ),
+                 void *arg );
+
 #endif // HASHADT_H
@@ -0,0 +1,494 @@
+/*
+* File: Image.c
+* Decription:
+* implements saving the social network to a binary image and mapping
+* an image back in so it can be used in place
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Image.h"
+
+#define IMAGE_MAGIC "AMICIIMG"
+
+// written in the writer's byte order; reads back differently on a
+// machine of the other order
+#define IMAGE_BYTE_ORDER 0x01020304u
+
+// the tail of the file is buffered in blocks of this size while saving
+#define SAVE_BUFFER (1 << 20)
+
+/*
+*  struct header_s:
+*  The start of every image.  The record array follows it, then the
+*  friends arrays, then the string pool.
+*/
+typedef struct header_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t ids;
+    uint32_t people;
+    uint64_t entries;           // IDs in all friends arrays together
+    uint64_t pool_size;         // bytes in the string pool
+    uint64_t log;               // the client's stamp
+    uint64_t sequence;
+} header;
+
+/*
+*  struct record_s:
+*  One person ID.  name and handle are offsets into the string pool,
+*  friends an index into the friends arrays.
+*/
+typedef struct record_s {
+    uint64_t name;
+    uint64_t handle;
+    uint64_t friends;
+    uint32_t degree;
+    uint32_t live;
+} record;
+
+/*
+*  struct image_s:
+*  A structure representing a mapped image
+*/
+typedef struct image_s {
+    char *data;
+    size_t size;
+    const header *head;
+    const record *records;
+    uint32_t *friends;
+    char *pool;
+} image;
+
+
+/*
+*  static bool write_all(FILE *out, const void *data, size_t size):
+*
+*  @param out: The file being written.
+*  @param data: The bytes to write.
+*  @param size: The number of bytes.
+*  @return: Returns true if every byte was written.
+*/
+static bool write_all(FILE *out, const void *data, size_t size){
+    return size == 0 || fwrite(data, 1, size, out) == size;
+}
+
+/*
+*  struct image_save:
+*
+*  Makes three passes over the people: the records (whose offsets are
+*  running sums, so they need no buffer), the friends arrays, and the
+*  strings.  The header, which needs the totals, is rewritten last.
+*
+*  @param path: The file to write.
+*  @param ids: The number of person IDs.
+*  @param person: Function describing the person with a given ID.
+*  @param arg: Passed through to person.
+*  @param stamp: The stamp to save.
+*  @param reason: Out parameter describing a failure.
+*  @return: Returns true on success.
+*/
+bool image_save(const char *path, uint32_t ids,
+        bool (*person)(uint32_t id, ImagePerson *out, void *arg), void *arg,
+        ImageStamp stamp, const char **reason){
+
+    size_t path_length = strlen(path);
+    char *temp = malloc(path_length + sizeof(".tmp"));
+    if (temp == NULL) {
+        *reason = strerror(ENOMEM);
+        return false;
+    }
+    memcpy(temp, path, path_length);
+    memcpy(temp + path_length, ".tmp", sizeof(".tmp"));
+
+    FILE *out = fopen(temp, "wb");
+    if (out == NULL) {
+        *reason = strerror(errno);
+        free(temp);
+        return false;
+    }
+    setvbuf(out, NULL, _IOFBF, SAVE_BUFFER);
+
+    header head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, IMAGE_MAGIC, sizeof(head.magic));
+    head.version = IMAGE_VERSION;
+    head.byte_order = IMAGE_BYTE_ORDER;
+    head.ids = ids;
+    head.log = stamp.log;
+    head.sequence = stamp.sequence;
+
+    bool ok = write_all(out, &head, sizeof(head));
+
+    ImagePerson p;
+    for (uint32_t id = 0; ok && id < ids; ++id) {
+        record r;
+        memset(&r, 0, sizeof(r));
+
+        if (person(id, &p, arg)) {
+            size_t name_length = strlen(p.name) + 1;
+            r.name = head.pool_size;
+            r.handle = head.pool_size + name_length;
+            r.friends = head.entries;
+            r.degree = (uint32_t)p.friend_count;
+            r.live = 1;
+
+            head.pool_size += name_length + strlen(p.handle) + 1;
+            head.entries += p.friend_count;
+            head.people++;
+        }
+
+        ok = write_all(out, &r, sizeof(r));
+    }
+
+    for (uint32_t id = 0; ok && id < ids; ++id) {
+        if (person(id, &p, arg)) {
+            ok = write_all(out, p.friends, p.friend_count * sizeof(uint32_t));
+        }
+    }
+
+    for (uint32_t id = 0; ok && id < ids; ++id) {
+        if (person(id, &p, arg)) {
+            ok = write_all(out, p.name, strlen(p.name) + 1)
+                    && write_all(out, p.handle, strlen(p.handle) + 1);
+        }
+    }
+
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && write_all(out, &head, sizeof(head));
+
+    // the image must be on disk before it replaces the old one
+    ok = ok && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if (!ok) {
+        *reason = strerror(errno);
+    }
+
+    if (fclose(out) != 0 && ok) {
+        *reason = strerror(errno);
+        ok = false;
+    }
+
+    if (ok && rename(temp, path) != 0) {
+        *reason = strerror(errno);
+        ok = false;
+    }
+
+    if (!ok) {
+        remove(temp);
+    }
+
+    free(temp);
+
+    return ok;
+}
+
+/*
+*  static const char *check_friends(const Image img):
+*
+*  Checks that every friend ID names a live record other than its own,
+*  that no list names anyone twice, and that every friendship appears
+*  in both lists, so a client can follow and unlink either side.
+*
+*  The friendships are sorted by the friend they name, counting sort
+*  style, into who names each person.  Each person's own list is then
+*  stamped in seen, and everyone naming them must carry their stamp;
+*  with no list naming anyone twice and the two lists the same length,
+*  the two are the same set.
+*
+*  @param img: The image, with every record's bounds already checked.
+*  @return: Returns NULL if the friends lists are sound, or what is
+*           wrong with them.
+*/
+static const char *check_friends(const Image img){
+
+    const header *head = img->head;
+    const char *problem = NULL;
+
+    uint64_t *starts = calloc((size_t)head->ids + 1, sizeof(uint64_t));
+    uint32_t *seen = calloc((size_t)head->ids + 1, sizeof(uint32_t));
+    uint32_t *named_by = malloc((head->entries + 1) * sizeof(uint32_t));
+    if (starts == NULL || seen == NULL || named_by == NULL) {
+        free(starts);
+        free(seen);
+        free(named_by);
+        return strerror(ENOMEM);
+    }
+
+    for (uint32_t id = 0; id < head->ids && problem == NULL; ++id) {
+        const record *r = &img->records[id];
+        for (uint32_t i = 0; r->live && i < r->degree; ++i) {
+            uint32_t friend = img->friends[r->friends + i];
+            if (friend == id || !img->records[friend].live) {
+                problem = "image friends list is corrupt";
+                break;
+            }
+            starts[friend + 1]++;
+        }
+    }
+
+    // starts[v] becomes where v's namers go; the fill moves it to the end
+    for (uint32_t id = 0; id < head->ids; ++id) {
+        starts[id + 1] += starts[id];
+    }
+    for (uint32_t id = 0; id < head->ids && problem == NULL; ++id) {
+        const record *r = &img->records[id];
+        for (uint32_t i = 0; r->live && i < r->degree; ++i) {
+            named_by[starts[img->friends[r->friends + i]]++] = id;
+        }
+    }
+
+    uint64_t begin = 0;
+    for (uint32_t id = 0; id < head->ids && problem == NULL; ++id) {
+        const record *r = &img->records[id];
+        uint64_t end = starts[id];
+
+        for (uint32_t i = 0; r->live && i < r->degree; ++i) {
+            uint32_t friend = img->friends[r->friends + i];
+            if (seen[friend] == id + 1) {
+                problem = "image friends list is corrupt";
+                break;
+            }
+            seen[friend] = id + 1;
+        }
+
+        if (end - begin != (r->live ? r->degree : 0)) {
+            problem = "image friendships are not symmetric";
+        }
+        for (uint64_t n = begin; n < end && problem == NULL; ++n) {
+            if (seen[named_by[n]] != id + 1) {
+                problem = "image friendships are not symmetric";
+            }
+        }
+
+        begin = end;
+    }
+
+    free(starts);
+    free(seen);
+    free(named_by);
+
+    return problem;
+}
+
+/*
+*  static const char *check(const Image img):
+*
+*  Checks that every offset in the image stays inside it, so nothing
+*  handed out later can point outside the mapping, and then that the 
+*  friends lists are sound.
+*
+*  @param img: The image, with its sections located.
+*  @return: Returns NULL if the image is sound, or what is wrong with it.
+*/
+static const char *check(const Image img){
+
+    const header *head = img->head;
+    uint32_t people = 0;
+
+    if (head->pool_size > 0 && img->pool[head->pool_size - 1] != '\0') {
+        return "image string pool is corrupt";
+    }
+
+    for (uint32_t id = 0; id < head->ids; ++id) {
+        const record *r = &img->records[id];
+        if (!r->live) {
+            continue;
+        }
+
+        people++;
+        if (r->name >= head->pool_size || r->handle >= head->pool_size
+                || r->friends > head->entries || r->degree > head->entries - r->friends) {
+            return "image record is corrupt";
+        }
+
+        for (uint32_t i = 0; i < r->degree; ++i) {
+            if (img->friends[r->friends + i] >= head->ids) {
+                return "image friends list is corrupt";
+            }
+        }
+    }
+
+    if (people != head->people) {
+        return "image record is corrupt";
+    }
+
+    return check_friends(img);
+}
+
+/*
+*  struct image_open:
+*
+*  Maps the file privately and writably, then checks the header, the
+*  section sizes against the file size, and every record.
+*
+*  @param path: The file to read.
+*  @param reason: Out parameter describing a failure.
+*  @return: Returns the image, or NULL on failure.
+*/
+Image image_open(const char *path, const char **reason){
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *reason = strerror(errno);
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        *reason = strerror(errno);
+        close(fd);
+        return NULL;
+    }
+
+    if ((size_t)info.st_size < sizeof(header)) {
+        *reason = "not an amici image";
+        close(fd);
+        return NULL;
+    }
+
+    Image img = malloc(sizeof(image));
+    if (img == NULL) {
+        *reason = strerror(ENOMEM);
+        close(fd);
+        return NULL;
+    }
+
+    img->size = (size_t)info.st_size;
+    void *map = mmap(NULL, img->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        *reason = strerror(errno);
+        free(img);
+        return NULL;
+    }
+
+    img->data = map;
+    img->head = map;
+
+    const header *head = img->head;
+    *reason = NULL;
+
+    if (memcmp(head->magic, IMAGE_MAGIC, sizeof(head->magic)) != 0) {
+        *reason = "not an amici image";
+    } else if (head->byte_order != IMAGE_BYTE_ORDER) {
+        *reason = "image was written on a machine of the other byte order";
+    } else if (head->version != IMAGE_VERSION) {
+        *reason = "unsupported image version";
+    } else {
+        // each section must fit in what is left of the file
+        size_t left = img->size - sizeof(header);
+        uint64_t records = (uint64_t)head->ids * sizeof(record);
+        if (records > left || head->entries > (left - records) / sizeof(uint32_t)
+                || head->pool_size != left - records - head->entries * sizeof(uint32_t)) {
+            *reason = "image is truncated";
+        } else {
+            img->records = (const record *)(img->data + sizeof(header));
+            img->friends = (uint32_t *)(img->data + sizeof(header) + records);
+            img->pool = img->data + sizeof(header) + records + head->entries * sizeof(uint32_t);
+            *reason = check(img);
+        }
+    }
+
+    if (*reason != NULL) {
+        munmap(img->data, img->size);
+        free(img);
+        return NULL;
+    }
+
+    return img;
+}
+
+/*
+*  struct image_close:
+*
+*  @param img: The image to be closed.
+*/
+void image_close(Image img){
+
+    if (img == NULL) {
+        return;
+    }
+
+    munmap(img->data, img->size);
+    free(img);
+}
+
+/*
+*  struct image_ids:
+*
+*  @param img: The image.
+*  @return: Returns the number of person IDs.
+*/
+uint32_t image_ids(const Image img){
+    return img->head->ids;
+}
+
+/*
+*  struct image_people:
+*
+*  @param img: The image.
+*  @return: Returns the number of people.
+*/
+uint32_t image_people(const Image img){
+    return img->head->people;
+}
+
+/*
+*  struct image_stamp:
+*
+*  @param img: The image.
+*  @return: Returns the stamp the image was saved with.
+*/
+ImageStamp image_stamp(const Image img){
+
+    ImageStamp stamp;
+    stamp.log = img->head->log;
+    stamp.sequence = img->head->sequence;
+
+    return stamp;
+}
+
+/*
+*  struct image_person:
+*
+*  @param img: The image.
+*  @param id: A person ID.
+*  @param out: Out parameter receiving pointers into the mapping.
+*  @return: Returns false for a vacant ID.
+*/
+bool image_person(const Image img, uint32_t id, ImagePerson *out){
+
+    const record *r = &img->records[id];
+    if (!r->live) {
+        return false;
+    }
+
+    out->name = img->pool + r->name;
+    out->handle = img->pool + r->handle;
+    out->friends = r->degree > 0 ? img->friends + r->friends : NULL;
+    out->friend_count = r->degree;
+
+    return true;
+}
+
+/*
+*  struct image_contains:
+*
+*  @param img: The image.
+*  @param p: A pointer.
+*  @return: Returns true if p lies inside the mapping.
+*/
+bool image_contains(const Image img, const void *p){
+    return img != NULL && (const char *)p >= img->data && (const char *)p < img->data + img->size;
+}
@@ -0,0 +1,140 @@
+/// \file Image.h
+/// \brief A versioned binary image of the whole social network, read in
+/// place through a memory mapping.
+///
+/// @author Connor Patterson
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+#include <stdbool.h>    // bool
+
+/// Format version written by image_save(); other versions are refused
+#define IMAGE_VERSION 2
+
+///
+/// General Notes on image Operation
+///
+/// - An image holds one record per person ID (vacant IDs included, so
+///   IDs survive a save and load), every friends list as one array of
+///   IDs, and every name and handle in one pool of terminated strings.
+///
+/// - image_open() maps the file privately and checks it once: every
+///   offset stays inside the file, and every friends list names only
+///   other live people, nobody twice, and only people whose own list
+///   names it back.  After that the names, handles and friends lists it
+///   hands out point straight into the mapping.  They may be written to
+///   (the changes never reach the file) and stay valid until
+///   image_close().
+///
+/// - image_save() writes a temporary file next to the target and renames
+///   it into place, so an image that is open, or the previous image on a
+///   crash, is never left half written.
+///
+/// - Every image carries a stamp the client chooses when saving it, such
+///   as the log position the image is up to date with.
+///
+
+///
+/// One person as stored in an image.
+///
+typedef struct {
+    char *name;
+    char *handle;
+    uint32_t *friends;          ///< friends' IDs, NULL when there are none
+    size_t friend_count;
+} ImagePerson;
+
+///
+/// What an image is up to date with: the ID of a log and the sequence
+/// number of the last record of it the image includes.  Zero for both
+/// when there is no log.
+///
+typedef struct {
+    uint64_t log;
+    uint64_t sequence;
+} ImageStamp;
+
+///
+/// The Image data type is a pointer to an opaque structure.
+///
+typedef struct image_s *Image;
+
+///
+/// Write an image.
+///
+/// @param path The file to write
+/// @param ids The number of person IDs
+/// @param person Function filling in the person with ID id, returning
+///               false if the ID is vacant
+/// @param arg Passed through to person
+/// @param stamp The stamp to save with the image
+/// @param reason Set to a description of the failure, if there is one
+///
+/// @return true if the image was written
+///
+bool image_save( const char *path, uint32_t ids,
+    bool (*person)( uint32_t id, ImagePerson *out, void *arg ), void *arg,
+    ImageStamp stamp, const char **reason );
+
+///
+/// Map and check an image.
+///
+/// @param path The file to read
+/// @param reason Set to a description of the failure, if there is one
+///
+/// @return A newly opened image, or NULL
+///
+Image image_open( const char *path, const char **reason );
+
+///
+/// Unmap an image.
+///
+/// @param img The image to close, or NULL
+///
+/// @post img is not a valid instance of image, and nothing it handed
+///       out may be used.
+///
+void image_close( Image img );
+
+///
+/// @param img The image
+///
+/// @return The number of person IDs, vacant ones included
+///
+uint32_t image_ids( const Image img );
+
+///
+/// @param img The image
+///
+/// @return The number of people
+///
+uint32_t image_people( const Image img );
+
+///
+/// @param img The image
+///
+/// @return The stamp the image was saved with
+///
+ImageStamp image_stamp( const Image img );
+
+///
+/// @param img The image
+/// @param id A person ID below image_ids()
+/// @param out Receives the person
+///
+/// @return false if the ID is vacant
+///
+bool image_person( const Image img, uint32_t id, ImagePerson *out );
+
+///
+/// @param img The image, or NULL
+/// @param p Any pointer
+///
+/// @return true if p points into the image's mapping
+///
+bool image_contains( const Image img, const void *p );
+
+#endif // IMAGE_H
@@ -0,0 +1,218 @@
+/*
+* File: Loader.c
+* Decription:
+* implements a loader that maps a command file into memory and splits
+* it into lines and tokens in place
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Loader.h"
+
+/*
+*  struct loader_s:
+*  A structure representing a loader
+*
+*  The mapping covers data[0 .. size).  pos is the start of the next line.
+*  A last line without a newline has no byte after it to terminate its
+*  last token in, so it is copied into tail instead.
+*/
+typedef struct loader_s {
+    char *data;
+    size_t size;
+    size_t pos;
+    char *tail;
+} loader;
+
+
+/*
+*  static bool is_space(char c):
+*
+*  @param c: A character.
+*  @return: Returns true for the characters isspace() accepts in the C
+*  locale, the ones sscanf's %s stops at.
+*/
+static bool is_space(char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+*  static char *line_end(const Loader l, size_t from):
+*
+*  @param l: The loader.
+*  @param from: The start of a line.
+*  @return: Returns the line's newline, or the end of the data.
+*/
+static char *line_end(const Loader l, size_t from){
+    char *newline = memchr(l->data + from, '\n', l->size - from);
+    return newline != NULL ? newline : l->data + l->size;
+}
+
+/*
+*  struct loader_open:
+*
+*  Maps the file privately and writably, so terminators can be written
+*  into the mapping without reaching the file.
+*
+*  @param path: The file to read.
+*  @return: Returns a new loader, or NULL on failure.
+*/
+Loader loader_open(const char *path){
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+
+    Loader l = malloc(sizeof(loader));
+    if (l == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    l->size = (size_t)info.st_size;
+    l->pos = 0;
+    l->tail = NULL;
+    l->data = NULL;
+
+    if (l->size > 0) {
+        void *map = mmap(NULL, l->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            free(l);
+            return NULL;
+        }
+        l->data = map;
+        posix_madvise(map, l->size, POSIX_MADV_SEQUENTIAL);
+    }
+
+    // the mapping keeps the file open
+    close(fd);
+
+    return l;
+}
+
+/*
+*  struct loader_close:
+*
+*  @param l: The loader to be closed.
+*/
+void loader_close(Loader l){
+
+    if (l == NULL) {
+        return;
+    }
+
+    if (l->data != NULL) {
+        munmap(l->data, l->size);
+    }
+    free(l->tail);
+    free(l);
+}
+
+/*
+*  struct loader_count:
+*
+*  Compares the first token of each remaining line against command.
+*
+*  @param l: The loader.
+*  @param command: The command to count.
+*  @return: Returns the number of lines starting with command.
+*/
+size_t loader_count(const Loader l, const char *command){
+
+    size_t length = strlen(command);
+    size_t count = 0;
+
+    for (size_t pos = l->pos; pos < l->size; ) {
+        char *end = line_end(l, pos);
+        char *p = l->data + pos;
+
+        while (p < end && is_space(*p)) {
+            ++p;
+        }
+        if ((size_t)(end - p) > length && memcmp(p, command, length) == 0 && is_space(p[length])) {
+            count++;
+        }
+
+        pos = (size_t)(end - l->data) + 1;
+    }
+
+    return count;
+}
+
+/*
+*  struct loader_next:
+*
+*  Splits the next line at whitespace, terminating each token in place.
+*
+*  @param l: The loader.
+*  @param line: Out parameter receiving the tokens.
+*  @return: Returns false when there are no lines left.
+*/
+bool loader_next(Loader l, LoaderLine *line){
+
+    if (l->pos >= l->size) {
+        return false;
+    }
+
+    char *start = l->data + l->pos;
+    char *end = line_end(l, l->pos);
+    l->pos = (size_t)(end - l->data) + 1;
+
+    if (end == l->data + l->size) {
+        // the last line has no newline to overwrite; split a copy of it
+        size_t length = (size_t)(end - start);
+        free(l->tail);
+        l->tail = malloc(length + 1);
+        if (l->tail == NULL) {
+            return false;
+        }
+        memcpy(l->tail, start, length);
+        l->tail[length] = '\0';
+        start = l->tail;
+        end = l->tail + length;
+    }
+
+    line->count = 0;
+
+    char *p = start;
+    while (line->count < LOADER_MAX_TOKENS) {
+        while (p < end && is_space(*p)) {
+            ++p;
+        }
+        if (p == end) {
+            break;
+        }
+
+        LoaderToken *token = &line->tokens[line->count++];
+        token->text = p;
+        while (p < end && !is_space(*p)) {
+            ++p;
+        }
+        token->length = (size_t)(p - token->text);
+
+        // *end is the newline, or the copy's terminator, so this is safe
+        // even for the line's last token
+        *p = '\0';
+        if (p < end) {
+            ++p;
+        }
+    }
+
+    return true;
+}
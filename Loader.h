@@ -0,0 +1,94 @@
+/// \file Loader.h
+/// \brief Reads a command file by mapping it and splitting it in place.
+///
+/// @author Connor Patterson
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>     // size_t
+#include <stdbool.h>    // bool
+
+/// Most tokens of a line handed to the client; later ones are ignored
+#define LOADER_MAX_TOKENS 4
+
+///
+/// General Notes on loader Operation
+///
+/// - The file is mapped privately into memory and split into lines and
+///   tokens where it lies: the whitespace after each token is overwritten
+///   with a terminator, so a token is both a (text, length) view and a C
+///   string, and nothing is copied or cleared per line.
+///
+/// - Tokens stay valid until loader_close(); the file itself is never
+///   changed.
+///
+/// - Only regular files can be mapped.  loader_open() fails for anything
+///   else (a pipe or a terminal, say), and the client is expected to fall
+///   back to reading the stream.
+///
+
+///
+/// One token of a line.  text is terminated, and length excludes the
+/// terminator.
+///
+typedef struct {
+    char *text;
+    size_t length;
+} LoaderToken;
+
+///
+/// One line of the file, split at whitespace.
+///
+typedef struct {
+    LoaderToken tokens[LOADER_MAX_TOKENS];
+    size_t count;       ///< tokens found, at most LOADER_MAX_TOKENS
+} LoaderLine;
+
+///
+/// The Loader data type is a pointer to an opaque structure.
+///
+typedef struct loader_s *Loader;
+
+///
+/// Map a file for reading.
+///
+/// @param path The file to read
+///
+/// @return A loader positioned at the first line, or NULL if the file
+///         cannot be opened or mapped
+///
+Loader loader_open( const char *path );
+
+///
+/// Unmap the file.
+///
+/// @param l The loader to close, or NULL
+///
+/// @post l is not a valid instance of loader, and no token from it may
+///       be used.
+///
+void loader_close( Loader l );
+
+///
+/// Count the lines, from the current one onwards, whose first token is
+/// command, without splitting them.
+///
+/// @param l The loader
+/// @param command The command to look for
+///
+/// @return The number of such lines
+///
+size_t loader_count( const Loader l, const char *command );
+
+///
+/// Split the next line into tokens.
+///
+/// @param l The loader
+/// @param line Receives the line's tokens; a blank line has none
+///
+/// @return false once every line has been read
+///
+bool loader_next( Loader l, LoaderLine *line );
+
+#endif // LOADER_H
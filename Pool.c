@@ -0,0 +1,368 @@
+/*
+* File: Pool.c
+* Decription:
+* implements a pool of threads that runs a graph of dependent tasks,
+* each thread keeping its own queue and stealing from the others
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include "Pool.h"
+
+/*
+*  struct queue_s:
+*  The tasks one thread has made ready, tasks[top .. bottom-1]
+*
+*  The owner pushes and pops at the bottom, and other threads steal at
+*  the top.  A task is pushed at most once per run, so a queue never
+*  needs more room than the run has tasks.
+*/
+typedef struct queue_s {
+    pthread_mutex_t lock;
+    size_t *tasks;
+    size_t top;
+    size_t bottom;
+} queue;
+
+/*
+*  struct helper_s:
+*  One of the pool's threads, which works on the queue numbered self
+*/
+typedef struct helper_s {
+    pthread_t thread;
+    struct pool_s *pool;
+    size_t self;
+} helper;
+
+/*
+*  struct pool_s:
+*  A structure representing the pool
+*
+*  The thread calling pool_run() works on queue 0 and the helpers on the
+*  rest.  busy counts the helpers inside a run, which pool_run() waits
+*  to leave before it returns or sets up the next one.  available counts
+*  tasks queued and not yet taken, and sleeping the threads waiting for
+*  one, so whoever queues a task knows whether to wake anybody.
+*/
+struct pool_s {
+    size_t threads;
+    helper *helpers;
+    queue *queues;
+    size_t capacity;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;           // a run began, or the pool is stopping
+    pthread_cond_t ready;           // a task was queued, or the run finished
+    pthread_cond_t idle;            // busy dropped to 0
+    unsigned long run;
+    size_t busy;
+    size_t sleeping;
+    bool stopping;
+
+    size_t *waits;
+    const size_t *next_start;
+    const size_t *next;
+    void (*task)(size_t index, void *arg);
+    void *arg;
+    size_t remaining;
+    size_t available;
+};
+
+
+/*
+*  static void push(Pool p, size_t self, size_t t):
+*
+*  Queues a task that just became ready on a thread's own queue, waking
+*  a waiting thread if there is one.
+*
+*  @param p: The pool.
+*  @param self: The thread's queue.
+*  @param t: The task.
+*/
+static void push(Pool p, size_t self, size_t t){
+
+    queue *q = &p->queues[self];
+    pthread_mutex_lock(&q->lock);
+    q->tasks[q->bottom++] = t;
+    pthread_mutex_unlock(&q->lock);
+
+    __atomic_fetch_add(&p->available, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&p->sleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->ready);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/*
+*  static bool take(Pool p, size_t self, size_t *t):
+*
+*  Takes the newest task from a thread's own queue, or failing that the
+*  oldest task from another's.
+*
+*  @param p: The pool.
+*  @param self: The thread's queue.
+*  @param t: Out parameter receiving the task.
+*  @return: Returns false if every queue was empty.
+*/
+static bool take(Pool p, size_t self, size_t *t){
+
+    for (size_t i = 0; i < p->threads; ++i) {
+        queue *q = &p->queues[(self + i) % p->threads];
+        bool found = false;
+
+        pthread_mutex_lock(&q->lock);
+        if (q->top < q->bottom) {
+            *t = i == 0 ? q->tasks[--q->bottom] : q->tasks[q->top++];
+            found = true;
+        }
+        pthread_mutex_unlock(&q->lock);
+
+        if (found) {
+            __atomic_fetch_sub(&p->available, 1, __ATOMIC_SEQ_CST);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+*  static void work_on(Pool p, size_t self):
+*
+*  Runs tasks until every task of the current run is done, releasing
+*  the tasks each one was holding up.
+*
+*  @param p: The pool.
+*  @param self: The calling thread's queue.
+*/
+static void work_on(Pool p, size_t self){
+
+    while (__atomic_load_n(&p->remaining, __ATOMIC_ACQUIRE) > 0) {
+        size_t t;
+
+        if (!take(p, self, &t)) {
+            pthread_mutex_lock(&p->lock);
+            __atomic_fetch_add(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&p->available, __ATOMIC_SEQ_CST) == 0
+                    && __atomic_load_n(&p->remaining, __ATOMIC_ACQUIRE) > 0) {
+                pthread_cond_wait(&p->ready, &p->lock);
+            }
+            __atomic_fetch_sub(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
+
+        p->task(t, p->arg);
+
+        for (size_t e = p->next_start[t]; e < p->next_start[t + 1]; ++e) {
+            size_t n = p->next[e];
+            if (__atomic_sub_fetch(&p->waits[n], 1, __ATOMIC_ACQ_REL) == 0) {
+                push(p, self, n);
+            }
+        }
+
+        if (__atomic_sub_fetch(&p->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+            pthread_mutex_lock(&p->lock);
+            pthread_cond_broadcast(&p->ready);
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+}
+
+/*
+*  static void *help(void *arg):
+*
+*  A helper thread: joins each run as it starts, until the pool stops.
+*
+*  @param arg: The helper.
+*  @return: Returns NULL once the pool is stopping.
+*/
+static void *help(void *arg){
+
+    helper *h = arg;
+    Pool p = h->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->run == seen && !p->stopping) {
+            pthread_cond_wait(&p->start, &p->lock);
+        }
+        if (p->stopping) {
+            break;
+        }
+
+        seen = p->run;
+        p->busy++;
+        pthread_mutex_unlock(&p->lock);
+
+        work_on(p, h->self);
+
+        pthread_mutex_lock(&p->lock);
+        if (--p->busy == 0) {
+            pthread_cond_signal(&p->idle);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+/*
+*  struct pool_create:
+*
+*  Creates a pool and starts its helper threads.
+*
+*  @param threads: The threads working on each run, the caller included.
+*  @return: Returns a Pool.
+*/
+Pool pool_create(size_t threads){
+
+    assert(threads > 0);
+
+    Pool p = calloc(1, sizeof(struct pool_s));
+    assert(p != NULL);
+
+    p->threads = threads;
+    p->queues = calloc(threads, sizeof(queue));
+    p->helpers = calloc(threads, sizeof(helper));
+    assert(p->queues != NULL && p->helpers != NULL);
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->ready, NULL);
+    pthread_cond_init(&p->idle, NULL);
+
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_mutex_init(&p->queues[i].lock, NULL);
+    }
+
+    for (size_t i = 1; i < threads; ++i) {
+        p->helpers[i].pool = p;
+        p->helpers[i].self = i;
+        int failed = pthread_create(&p->helpers[i].thread, NULL, help, &p->helpers[i]);
+        assert(failed == 0);
+        (void)failed;
+    }
+
+    return p;
+}
+
+/*
+*  struct pool_destroy:
+*
+*  Stops the helper threads, waits for them, and frees the pool.
+*
+*  @param p: The pool.
+*/
+void pool_destroy(Pool p){
+
+    if (p == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->stopping = true;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+
+    for (size_t i = 1; i < p->threads; ++i) {
+        pthread_join(p->helpers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < p->threads; ++i) {
+        pthread_mutex_destroy(&p->queues[i].lock);
+        free(p->queues[i].tasks);
+    }
+    pthread_cond_destroy(&p->idle);
+    pthread_cond_destroy(&p->ready);
+    pthread_cond_destroy(&p->start);
+    pthread_mutex_destroy(&p->lock);
+
+    free(p->queues);
+    free(p->helpers);
+    free(p);
+}
+
+/*
+*  struct pool_run:
+*
+*  Deals the tasks that are ready from the start out over the queues,
+*  wakes the helpers, and works on the run until it is done.
+*
+*  @param p: The pool.
+*  @param count: The number of tasks.
+*  @param waits: The number of edges arriving at each task.
+*  @param next_start: Where each task's edges start in next.
+*  @param next: The task each edge leads to.
+*  @param task: The function running a task.
+*  @param arg: Client data handed to task.
+*/
+void pool_run(Pool p, size_t count, size_t *waits,
+        const size_t *next_start, const size_t *next,
+        void (*task)(size_t index, void *arg), void *arg){
+
+    assert(p != NULL);
+
+    if (count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+
+    // a helper that woke late may still be leaving the last run
+    while (p->busy > 0) {
+        pthread_cond_wait(&p->idle, &p->lock);
+    }
+
+    if (p->capacity < count) {
+        for (size_t i = 0; i < p->threads; ++i) {
+            free(p->queues[i].tasks);
+            p->queues[i].tasks = malloc(count * sizeof(size_t));
+            assert(p->queues[i].tasks != NULL);
+        }
+        p->capacity = count;
+    }
+
+    p->waits = waits;
+    p->next_start = next_start;
+    p->next = next;
+    p->task = task;
+    p->arg = arg;
+    p->remaining = count;
+    p->available = 0;
+
+    for (size_t i = 0; i < p->threads; ++i) {
+        p->queues[i].top = 0;
+        p->queues[i].bottom = 0;
+    }
+
+    size_t deal = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (waits[i] == 0) {
+            queue *q = &p->queues[deal];
+            q->tasks[q->bottom++] = i;
+            p->available++;
+            deal = (deal + 1) % p->threads;
+        }
+    }
+
+    p->run++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+
+    work_on(p, 0);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->busy > 0) {
+        pthread_cond_wait(&p->idle, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,82 @@
+/// \file Pool.h
+/// \brief A pool of threads that runs a graph of dependent tasks, each
+/// thread stealing work from the others when it runs out.
+///
+/// @author Connor Patterson
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>     // size_t
+
+///
+/// General Notes on pool Operation
+///
+/// - A run is a set of tasks numbered 0 .. count-1 and the edges between
+///   them: a task only starts once every task with an edge to it has
+///   finished.  The edges leaving task i are next[next_start[i]] ..
+///   next[next_start[i+1]-1], and waits[i] is the number of edges
+///   arriving at it (an edge may appear more than once, as long as waits
+///   counts it as often).
+///
+/// - Every thread keeps its own queue of tasks that are ready to start.
+///   A thread takes the task it made ready last from its own queue, and
+///   when its queue is empty, steals the oldest task from another's.
+///
+/// - The thread calling pool_run() works on the run alongside the
+///   pool's threads, and pool_run() returns once every task is done.
+///
+/// - The edges must not form a cycle, or the run never finishes.
+///
+
+///
+/// The Pool data type is a pointer to an opaque structure.
+///
+typedef struct pool_s *Pool;
+
+///
+/// Create a pool.
+///
+/// @param threads The number of threads working on each run, counting
+///                the one calling pool_run() (at least 1)
+///
+/// @exception Assert fails if it cannot allocate space or start a thread
+///
+/// @return A newly created pool
+///
+Pool pool_create( size_t threads );
+
+///
+/// Stop the pool's threads and free the pool.
+///
+/// @param p The pool to destroy, or NULL
+///
+/// @pre No run is in progress.
+///
+/// @post p is not a valid instance of pool.
+///
+void pool_destroy( Pool p );
+
+///
+/// Run a graph of tasks and wait for it to finish.
+///
+/// @param p The pool
+/// @param count The number of tasks
+/// @param waits The number of edges arriving at each task; used up by
+///              the run, which leaves every entry 0
+/// @param next_start Where each task's edges start in next (count + 1
+///                   entries)
+/// @param next The task each edge leads to
+/// @param task Called once for each task, with its number and arg, from
+///             any of the threads
+/// @param arg Client data handed to every call of task
+///
+/// @exception Assert fails if it cannot allocate space
+///
+/// @pre p is a valid instance of pool, and the edges form no cycle.
+///
+void pool_run( Pool p, size_t count, size_t *waits,
+               const size_t *next_start, const size_t *next,
+               void (*task)( size_t index, void *arg ), void *arg );
+
+#endif // POOL_H
@@ -0,0 +1,791 @@
+/*
+* File: Server.c
+* Decription:
+* implements a server that reads command lines from clients on a Unix
+* domain socket, runs them on worker threads and answers in order
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "Server.h"
+
+// bytes read from a connection at a time
+#define READ_SIZE 65536
+
+// a connection stops being read while this much input waits to be run
+#define INPUT_LIMIT (16 * READ_SIZE)
+
+/*
+*  struct request_s:
+*  One command line and, once a worker has run it, its reply
+*/
+typedef struct request_s {
+    struct request_s *next;         // the connection's next request
+    struct request_s *queued;       // the next request on a worker's queue or the done list
+    struct connection_s *conn;
+    char *line;                     // the line, split in place
+    char *tokens[SERVER_MAX_TOKENS];
+    size_t count;
+    ServerRoute route;
+    size_t worker;
+    char *reply;
+    size_t length;
+    char header[24];
+    size_t header_length;
+    size_t sent;                    // bytes of header and reply written
+    bool done;
+} request;
+
+/*
+*  struct connection_s:
+*  One client
+*
+*  Only the dispatching thread touches a connection.  first .. last are
+*  the requests still to be answered, in order; running counts those
+*  handed to workers and not yet back.  held is a barrier request that
+*  is waiting for running to drop to 0.  in holds input not yet split
+*  into requests.
+*/
+typedef struct connection_s {
+    int fd;
+    char *in;
+    size_t in_length;
+    request *first;
+    request *last;
+    request *held;
+    size_t pending;
+    size_t running;
+    bool barrier;                   // a barrier request is running
+    bool eof;                       // the client has sent everything
+    bool closing;                   // quit: nothing more is read
+    bool broken;                    // replies can no longer be written
+} connection;
+
+/*
+*  struct worker_s:
+*  A worker thread and the queue of requests routed to it
+*/
+typedef struct worker_s {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    request *head;
+    request *tail;
+    bool stopping;
+    struct server_s *server;
+} worker;
+
+/*
+*  struct server_s:
+*  A structure representing a running server
+*
+*  Workers put finished requests on done and write a byte to wake, so
+*  the dispatching thread, waiting in poll(), picks them up.
+*/
+typedef struct server_s {
+    ServerRoute (*route)(char **tokens, size_t count, size_t *worker, void *arg);
+    void (*execute)(char **tokens, size_t count, FILE *reply, void *arg);
+    void (*flush)(void *arg);
+    void *arg;
+
+    worker *workers;
+    size_t worker_count;
+
+    pthread_mutex_t done_lock;
+    request *done;
+    int wake[2];
+
+    connection **conns;
+    size_t conn_count;
+    size_t conn_capacity;
+} server;
+
+// set by a signal; the handler also wakes the dispatching thread
+static volatile sig_atomic_t stop_requested = 0;
+static int stop_wake = -1;
+
+
+/*
+*  static void on_signal(int signal):
+*
+*  @param signal: SIGINT or SIGTERM.
+*/
+static void on_signal(int signal){
+    (void)signal;
+    stop_requested = 1;
+    if (stop_wake >= 0) {
+        ssize_t ignored = write(stop_wake, "", 1);
+        (void)ignored;
+    }
+}
+
+/*
+*  static bool is_space(char c):
+*
+*  @param c: A character.
+*  @return: Returns true for the characters sscanf's %s stops at.
+*/
+static bool is_space(char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+*  static void free_request(request *r):
+*
+*  @param r: The request to be freed.
+*/
+static void free_request(request *r){
+    free(r->line);
+    free(r->reply);
+    free(r);
+}
+
+/*
+*  static void *work(void *arg):
+*
+*  A worker: runs the requests on its queue in order, each into a
+*  reply of its own, and hands them back to the dispatching thread.
+*
+*  @param arg: The worker.
+*  @return: Returns NULL once the worker is stopped and its queue empty.
+*/
+static void *work(void *arg){
+
+    worker *w = arg;
+    server *s = w->server;
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->head == NULL && !w->stopping) {
+            pthread_cond_wait(&w->ready, &w->lock);
+        }
+        request *r = w->head;
+        if (r != NULL) {
+            w->head = r->queued;
+            if (w->head == NULL) {
+                w->tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        if (r == NULL) {
+            return NULL;
+        }
+
+        FILE *reply = open_memstream(&r->reply, &r->length);
+        if (reply != NULL) {
+            s->execute(r->tokens, r->count, reply, s->arg);
+            fclose(reply);
+        }
+
+        pthread_mutex_lock(&s->done_lock);
+        bool was_empty = s->done == NULL;
+        r->queued = s->done;
+        s->done = r;
+        pthread_mutex_unlock(&s->done_lock);
+
+        if (was_empty) {
+            ssize_t ignored = write(s->wake[1], "", 1);
+            (void)ignored;
+        }
+    }
+}
+
+/*
+*  static void hand_out(server *s, connection *c, request *r):
+*
+*  Adds a request to the connection's answers and to its worker's queue.
+*
+*  @param s: The server.
+*  @param c: The request's connection.
+*  @param r: The request.
+*/
+static void hand_out(server *s, connection *c, request *r){
+
+    if (c->last != NULL) {
+        c->last->next = r;
+    } else {
+        c->first = r;
+    }
+    c->last = r;
+    c->pending++;
+    c->running++;
+    if (r->route == SERVER_BARRIER) {
+        c->barrier = true;
+    }
+
+    worker *w = &s->workers[r->worker];
+    r->queued = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->tail != NULL) {
+        w->tail->queued = r;
+    } else {
+        w->head = r;
+    }
+    w->tail = r;
+    pthread_cond_signal(&w->ready);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/*
+*  static void dispatch(server *s, connection *c):
+*
+*  Splits the connection's complete lines into requests and hands them
+*  out, until one has to wait: a barrier behind running requests, any
+*  request behind a running barrier, or a full connection.
+*
+*  @param s: The server.
+*  @param c: The connection.
+*/
+static void dispatch(server *s, connection *c){
+
+    size_t pos = 0;
+
+    for (;;) {
+        if (c->held != NULL) {
+            if (c->running > 0) {
+                break;
+            }
+            request *r = c->held;
+            c->held = NULL;
+            hand_out(s, c, r);
+        }
+
+        if (c->closing || c->broken || c->barrier || c->pending >= SERVER_MAX_PENDING) {
+            break;
+        }
+
+        size_t left = c->in_length - pos;
+        if (left == 0) {
+            break;
+        }
+        size_t window = left < SERVER_MAX_LINE ? left : SERVER_MAX_LINE;
+        char *start = c->in + pos;
+        char *newline = memchr(start, '\n', window);
+
+        size_t length;
+        if (newline != NULL) {
+            length = (size_t)(newline - start);
+            pos += length + 1;
+        } else if (left >= SERVER_MAX_LINE || (c->eof && left > 0)) {
+            length = window;
+            pos += length;
+        } else {
+            break;
+        }
+
+        request *r = calloc(1, sizeof(request));
+        char *line = malloc(length + 1);
+        if (r == NULL || line == NULL) {
+            free(r);
+            free(line);
+            c->broken = true;
+            break;
+        }
+        memcpy(line, start, length);
+        line[length] = '\0';
+        r->line = line;
+        r->conn = c;
+
+        char *p = line;
+        while (r->count < SERVER_MAX_TOKENS) {
+            while (*p != '\0' && is_space(*p)) {
+                ++p;
+            }
+            if (*p == '\0') {
+                break;
+            }
+            r->tokens[r->count++] = p;
+            while (*p != '\0' && !is_space(*p)) {
+                ++p;
+            }
+            if (*p != '\0') {
+                *p++ = '\0';
+            }
+        }
+
+        r->worker = 0;
+        r->route = s->route(r->tokens, r->count, &r->worker, s->arg);
+        r->worker %= s->worker_count;
+
+        if (r->route == SERVER_CLOSE) {
+            free_request(r);
+            c->closing = true;
+        } else if (r->route == SERVER_BARRIER && c->running > 0) {
+            c->held = r;
+        } else {
+            hand_out(s, c, r);
+        }
+    }
+
+    if (pos > 0) {
+        memmove(c->in, c->in + pos, c->in_length - pos);
+        c->in_length -= pos;
+    }
+}
+
+/*
+*  static void answer(connection *c):
+*
+*  Writes the replies at the front of the connection's requests that
+*  are done, stopping at one that is not or when the socket is full.
+*  A connection whose replies cannot be written drops them.
+*
+*  @param c: The connection.
+*/
+static void answer(connection *c){
+
+    while (c->first != NULL && c->first->done) {
+        request *r = c->first;
+
+        if (!c->broken) {
+            size_t total = r->header_length + r->length;
+            while (r->sent < total) {
+                struct iovec parts[2];
+                int count = 0;
+                if (r->sent < r->header_length) {
+                    parts[count].iov_base = r->header + r->sent;
+                    parts[count++].iov_len = r->header_length - r->sent;
+                }
+                if (r->length > 0) {
+                    size_t skip = r->sent > r->header_length ? r->sent - r->header_length : 0;
+                    parts[count].iov_base = r->reply + skip;
+                    parts[count++].iov_len = r->length - skip;
+                }
+
+                struct msghdr message;
+                memset(&message, 0, sizeof(message));
+                message.msg_iov = parts;
+                message.msg_iovlen = count;
+
+                ssize_t written = sendmsg(c->fd, &message, MSG_NOSIGNAL);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return;
+                    }
+                    c->broken = true;
+                    break;
+                }
+                r->sent += (size_t)written;
+            }
+        }
+
+        c->first = r->next;
+        if (c->first == NULL) {
+            c->last = NULL;
+        }
+        c->pending--;
+        free_request(r);
+    }
+}
+
+/*
+*  static bool receive(connection *c):
+*
+*  Reads what the client has sent into the connection's input.
+*
+*  @param c: The connection.
+*  @return: Returns false if the input could not grow.
+*/
+static bool receive(connection *c){
+
+    char *in = realloc(c->in, c->in_length + READ_SIZE);
+    if (in == NULL) {
+        return false;
+    }
+    c->in = in;
+
+    ssize_t got = read(c->fd, c->in + c->in_length, READ_SIZE);
+    if (got > 0) {
+        c->in_length += (size_t)got;
+    } else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        c->eof = true;
+    }
+
+    return true;
+}
+
+/*
+*  static bool reading(const connection *c):
+*
+*  @param c: The connection.
+*  @return: Returns true if the connection should be polled for input.
+*/
+static bool reading(const connection *c){
+    return !c->eof && !c->closing && !c->broken && c->in_length < INPUT_LIMIT;
+}
+
+/*
+*  static bool finished(const connection *c):
+*
+*  @param c: The connection.
+*  @return: Returns true once nothing more will be read from, run for
+*  or written to the connection.
+*/
+static bool finished(const connection *c){
+    return c->running == 0 && c->first == NULL && c->held == NULL
+            && (c->broken || c->closing || (c->eof && c->in_length == 0));
+}
+
+/*
+*  static void close_connection(connection *c):
+*
+*  @param c: A connection with nothing running, which is freed.
+*/
+static void close_connection(connection *c){
+
+    while (c->first != NULL) {
+        request *r = c->first;
+        c->first = r->next;
+        free_request(r);
+    }
+    if (c->held != NULL) {
+        free_request(c->held);
+    }
+
+    close(c->fd);
+    free(c->in);
+    free(c);
+}
+
+/*
+*  static void accept_clients(server *s, int listener):
+*
+*  Accepts every connection waiting on the listening socket.
+*
+*  @param s: The server.
+*  @param listener: The listening socket.
+*/
+static void accept_clients(server *s, int listener){
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+
+        if (s->conn_count == s->conn_capacity) {
+            size_t capacity = s->conn_capacity == 0 ? 16 : 2 * s->conn_capacity;
+            connection **conns = realloc(s->conns, capacity * sizeof(connection *));
+            if (conns == NULL) {
+                close(fd);
+                return;
+            }
+            s->conns = conns;
+            s->conn_capacity = capacity;
+        }
+
+        connection *c = calloc(1, sizeof(connection));
+        if (c == NULL) {
+            close(fd);
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        c->fd = fd;
+
+        s->conns[s->conn_count++] = c;
+    }
+}
+
+/*
+*  static bool collect(server *s):
+*
+*  Takes the requests the workers have finished and marks them done.
+*
+*  @param s: The server.
+*  @return: Returns true if any request was finished.
+*/
+static bool collect(server *s){
+
+    char drain[256];
+    while (read(s->wake[0], drain, sizeof(drain)) > 0) {
+    }
+
+    pthread_mutex_lock(&s->done_lock);
+    request *r = s->done;
+    s->done = NULL;
+    pthread_mutex_unlock(&s->done_lock);
+
+    bool any = r != NULL;
+    while (r != NULL) {
+        request *next = r->queued;
+        connection *c = r->conn;
+
+        r->header_length = (size_t)snprintf(r->header, sizeof(r->header), "%zu\n", r->length);
+        r->done = true;
+        c->running--;
+        if (r->route == SERVER_BARRIER) {
+            c->barrier = false;
+        }
+
+        r = next;
+    }
+
+    return any;
+}
+
+/*
+*  static int listen_on(const char *path, const char **reason):
+*
+*  Creates the listening socket, replacing a stale socket left at path.
+*
+*  @param path: The socket path.
+*  @param reason: Out parameter describing a failure.
+*  @return: Returns the socket, or -1.
+*/
+static int listen_on(const char *path, const char **reason){
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        *reason = "socket path is too long";
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat info;
+    if (lstat(path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            *reason = "path exists and is not a socket";
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        *reason = strerror(errno);
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        *reason = strerror(errno);
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+/*
+*  static void stop_workers(server *s, size_t count):
+*
+*  Lets the first count workers finish their queues, and waits for them.
+*
+*  @param s: The server.
+*  @param count: The number of workers started.
+*/
+static void stop_workers(server *s, size_t count){
+
+    for (size_t i = 0; i < count; ++i) {
+        worker *w = &s->workers[i];
+        pthread_mutex_lock(&w->lock);
+        w->stopping = true;
+        pthread_cond_signal(&w->ready);
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        pthread_join(s->workers[i].thread, NULL);
+    }
+}
+
+/*
+*  static void serve(server *s, int listener):
+*
+*  The dispatching loop: waits on the listening socket, the wake pipe
+*  and every connection, then collects finished requests, flushes,
+*  accepts, reads, hands out and answers, until a signal arrives.
+*
+*  @param s: The server.
+*  @param listener: The listening socket.
+*/
+static void serve(server *s, int listener){
+
+    struct pollfd *fds = NULL;
+    size_t fds_capacity = 0;
+
+    while (!stop_requested) {
+        if (fds_capacity < s->conn_count + 2) {
+            fds_capacity = 2 * (s->conn_count + 2);
+            struct pollfd *grown = realloc(fds, fds_capacity * sizeof(struct pollfd));
+            if (grown == NULL) {
+                break;
+            }
+            fds = grown;
+        }
+
+        fds[0] = (struct pollfd){ listener, POLLIN, 0 };
+        fds[1] = (struct pollfd){ s->wake[0], POLLIN, 0 };
+        for (size_t i = 0; i < s->conn_count; ++i) {
+            connection *c = s->conns[i];
+            short events = reading(c) ? POLLIN : 0;
+            if (c->first != NULL && c->first->done && !c->broken) {
+                events |= POLLOUT;
+            }
+            fds[i + 2] = (struct pollfd){ events != 0 ? c->fd : -1, events, 0 };
+        }
+
+        if (poll(fds, s->conn_count + 2, -1) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (collect(s) && s->flush != NULL) {
+            s->flush(s->arg);
+        }
+
+        for (size_t i = 0; i < s->conn_count; ++i) {
+            connection *c = s->conns[i];
+            if ((fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) != 0 && reading(c) && !receive(c)) {
+                c->broken = true;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < s->conn_count; ++i) {
+            connection *c = s->conns[i];
+            dispatch(s, c);
+            answer(c);
+            if (finished(c)) {
+                close_connection(c);
+            } else {
+                s->conns[kept++] = c;
+            }
+        }
+        s->conn_count = kept;
+
+        if ((fds[0].revents & POLLIN) != 0) {
+            accept_clients(s, listener);
+        }
+    }
+
+    free(fds);
+}
+
+/*
+*  struct server_run:
+*
+*  Starts the workers and serves until a signal.  On the way out the
+*  workers finish what they were handed, the replies are flushed and
+*  written where the socket takes them, and every connection is closed.
+*
+*  @param path: The socket path.
+*  @param workers: The number of workers.
+*  @param route: Function routing each command.
+*  @param execute: Function running each command.
+*  @param flush: Function run before replies are sent, or NULL.
+*  @param arg: Passed through to the functions.
+*  @param reason: Out parameter describing a failure.
+*  @return: Returns false if the server could not start.
+*/
+bool server_run(const char *path, size_t workers,
+        ServerRoute (*route)(char **tokens, size_t count, size_t *worker, void *arg),
+        void (*execute)(char **tokens, size_t count, FILE *reply, void *arg),
+        void (*flush)(void *arg),
+        void *arg, const char **reason){
+
+    server s;
+    memset(&s, 0, sizeof(s));
+    s.route = route;
+    s.execute = execute;
+    s.flush = flush;
+    s.arg = arg;
+    s.worker_count = workers > 0 ? workers : 1;
+
+    int listener = listen_on(path, reason);
+    if (listener < 0) {
+        return false;
+    }
+
+    s.workers = calloc(s.worker_count, sizeof(worker));
+    if (s.workers == NULL || pipe(s.wake) != 0) {
+        *reason = s.workers == NULL ? strerror(ENOMEM) : strerror(errno);
+        free(s.workers);
+        close(listener);
+        unlink(path);
+        return false;
+    }
+    fcntl(s.wake[0], F_SETFL, fcntl(s.wake[0], F_GETFL) | O_NONBLOCK);
+    fcntl(s.wake[1], F_SETFL, fcntl(s.wake[1], F_GETFL) | O_NONBLOCK);
+    pthread_mutex_init(&s.done_lock, NULL);
+
+    size_t started = 0;
+    for (; started < s.worker_count; ++started) {
+        worker *w = &s.workers[started];
+        w->server = &s;
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->ready, NULL);
+        if (pthread_create(&w->thread, NULL, work, w) != 0) {
+            pthread_mutex_destroy(&w->lock);
+            pthread_cond_destroy(&w->ready);
+            break;
+        }
+    }
+
+    bool ok = started == s.worker_count;
+    if (ok) {
+        struct sigaction action, old_int, old_term;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = on_signal;
+        sigemptyset(&action.sa_mask);
+
+        stop_requested = 0;
+        stop_wake = s.wake[1];
+        sigaction(SIGINT, &action, &old_int);
+        sigaction(SIGTERM, &action, &old_term);
+
+        serve(&s, listener);
+
+        sigaction(SIGINT, &old_int, NULL);
+        sigaction(SIGTERM, &old_term, NULL);
+        stop_wake = -1;
+    } else {
+        *reason = "cannot start worker threads";
+    }
+
+    stop_workers(&s, started);
+
+    if (collect(&s) && s.flush != NULL) {
+        s.flush(s.arg);
+    }
+    for (size_t i = 0; i < s.conn_count; ++i) {
+        answer(s.conns[i]);
+        close_connection(s.conns[i]);
+    }
+
+    for (size_t i = 0; i < started; ++i) {
+        pthread_mutex_destroy(&s.workers[i].lock);
+        pthread_cond_destroy(&s.workers[i].ready);
+    }
+    free(s.workers);
+    free(s.conns);
+    pthread_mutex_destroy(&s.done_lock);
+    close(s.wake[0]);
+    close(s.wake[1]);
+    close(listener);
+    unlink(path);
+
+    return ok;
+}
@@ -0,0 +1,87 @@
+/// \file Server.h
+/// \brief A command server on a local socket, running each command on a
+/// worker chosen by the client's routing function.
+///
+/// @author Connor Patterson
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>      // FILE
+#include <stddef.h>     // size_t
+#include <stdbool.h>    // bool
+
+/// Most tokens a command line is split into; the rest are dropped
+#define SERVER_MAX_TOKENS 4
+
+/// Longest command line; a longer one is split into lines of this length
+#define SERVER_MAX_LINE 1023
+
+/// Most commands of one connection that may wait for a reply at once
+#define SERVER_MAX_PENDING 4096
+
+///
+/// General Notes on server Operation
+///
+/// - Clients connect to a Unix domain stream socket and send commands
+///   one per line.  Each command gets exactly one reply, in the order
+///   the commands were sent: the reply's length in bytes in decimal,
+///   a newline, and then that many bytes of output.
+///
+/// - A client may send any number of commands without waiting for
+///   replies.  Reading from a connection pauses while it has
+///   SERVER_MAX_PENDING commands unanswered.
+///
+/// - Every command is routed to one of the workers, each a thread that
+///   runs its commands one at a time in the order they arrived.  A
+///   command routed as SERVER_SHARD only waits for commands of its own
+///   connection on the same worker; one routed as SERVER_BARRIER waits
+///   until every earlier command of its connection has finished, and
+///   holds back every later one until it has.  So if the commands a
+///   client routes to different workers as SERVER_SHARD never touch the
+///   same data, each connection sees the results it would see running
+///   its commands one after another.
+///
+/// - Replies are only sent once the flush function, if there is one,
+///   has run after their commands finished, so a client is never told
+///   about a change the flush function has yet to make durable.
+///
+/// - SIGINT and SIGTERM stop the server.  Commands already handed to
+///   workers finish and their replies are sent if the client is
+///   reading; the rest are dropped.
+///
+
+///
+/// How a command is run.
+///
+typedef enum {
+    SERVER_SHARD,       ///< on its worker, alongside the connection's other commands
+    SERVER_BARRIER,     ///< on its worker, alone among the connection's commands
+    SERVER_CLOSE        ///< not at all; the connection closes once answered
+} ServerRoute;
+
+///
+/// Serve clients until a signal stops the server.
+///
+/// @param path The path of the socket, which must not exist unless it is
+///             a stale socket
+/// @param workers The number of worker threads (at least 1)
+/// @param route Called on the dispatching thread with each command's
+///              tokens; returns how it runs, and sets *worker to the
+///              worker (below workers) that runs it
+/// @param execute Called on a worker to run a command, writing its
+///                output to reply
+/// @param flush Called on the dispatching thread before replies are
+///              sent, or NULL
+/// @param arg Passed through to route, execute and flush
+/// @param reason Set to a description of the failure, if there is one
+///
+/// @return false if the server could not start
+///
+bool server_run( const char *path, size_t workers,
+    ServerRoute (*route)( char **tokens, size_t count, size_t *worker, void *arg ),
+    void (*execute)( char **tokens, size_t count, FILE *reply, void *arg ),
+    void (*flush)( void *arg ),
+    void *arg, const char **reason );
+
+#endif // SERVER_H
@@ -0,0 +1,662 @@
+/*
+* File: Wal.c
+* Decription:
+* implements an append-only write-ahead log of checksummed, numbered
+* command records that is synced in groups
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "Wal.h"
+
+#define WAL_MAGIC "AMICIWAL"
+#define WAL_VERSION 1
+
+// a record longer than this is taken to be damage, not data
+#define WAL_MAX_RECORD (1 << 20)
+
+/*
+*  struct file_header_s:
+*  The start of every log.  Records follow it back to back, each a
+*  length and checksum and then a body of that length: the sequence
+*  number, the kind, the token count, and the tokens with terminators.
+*/
+typedef struct file_header_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t id;
+} file_header;
+
+#define RECORD_PREFIX (2 * sizeof(uint32_t))
+#define BODY_FIXED (sizeof(uint64_t) + 2)
+
+/*
+*  struct wal_s:
+*  A structure representing a log
+*
+*  pending counts records written but not yet synced; oldest is when
+*  the first of them was written.  buffer holds one record at a time.
+*  lock is held by every operation after recovery, and by the flusher,
+*  a thread started by recovery that syncs a group whose oldest record
+*  has waited group_ms when no append comes along to do it.
+*/
+typedef struct wal_s {
+    FILE *file;
+    char *path;
+    uint64_t id;
+    uint64_t sequence;
+    size_t pending;
+    struct timespec oldest;
+    size_t group_records;
+    unsigned group_ms;
+    unsigned char *buffer;
+    size_t buffer_size;
+    pthread_mutex_t lock;
+    pthread_cond_t waiting;         // a record began waiting, the window changed, or the log is closing
+    pthread_t flusher;
+    bool flushing;                  // the flusher was started
+    bool closing;
+} wal;
+
+
+/*
+*  static uint32_t crc32(const unsigned char *data, size_t size):
+*
+*  The IEEE CRC-32, a byte at a time from a table built on first use.
+*
+*  @param data: The bytes to check.
+*  @param size: The number of bytes.
+*  @return: Returns the checksum.
+*/
+static uint32_t crc32(const unsigned char *data, size_t size){
+
+    static uint32_t table[256];
+    static bool ready = false;
+
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        ready = true;
+    }
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/*
+*  static bool reserve(Wal w, size_t size):
+*
+*  @param w: The log.
+*  @param size: The number of bytes the record buffer must hold.
+*  @return: Returns false if the buffer could not grow.
+*/
+static bool reserve(Wal w, size_t size){
+
+    if (size <= w->buffer_size) {
+        return true;
+    }
+
+    unsigned char *buffer = realloc(w->buffer, size);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    w->buffer = buffer;
+    w->buffer_size = size;
+    return true;
+}
+
+/*
+*  static size_t encode(Wal w, uint64_t sequence, WalKind kind, char *const *tokens, size_t count):
+*
+*  Builds a whole record, prefix included, in the record buffer.
+*
+*  @param w: The log.
+*  @param sequence: The record's sequence number.
+*  @param kind: The kind of record.
+*  @param tokens: The record's tokens.
+*  @param count: The number of tokens.
+*  @return: Returns the record's size, or 0 if it is too large.
+*/
+static size_t encode(Wal w, uint64_t sequence, WalKind kind, char *const *tokens, size_t count){
+
+    size_t body = BODY_FIXED;
+    for (size_t i = 0; i < count; ++i) {
+        body += strlen(tokens[i]) + 1;
+    }
+
+    if (count > WAL_MAX_TOKENS || body > WAL_MAX_RECORD || !reserve(w, RECORD_PREFIX + body)) {
+        return 0;
+    }
+
+    unsigned char *p = w->buffer + RECORD_PREFIX;
+    memcpy(p, &sequence, sizeof(sequence));
+    p[sizeof(sequence)] = (unsigned char)kind;
+    p[sizeof(sequence) + 1] = (unsigned char)count;
+    p += BODY_FIXED;
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t length = strlen(tokens[i]) + 1;
+        memcpy(p, tokens[i], length);
+        p += length;
+    }
+
+    uint32_t length = (uint32_t)body;
+    uint32_t crc = crc32(w->buffer + RECORD_PREFIX, body);
+    memcpy(w->buffer, &length, sizeof(length));
+    memcpy(w->buffer + sizeof(length), &crc, sizeof(crc));
+
+    return RECORD_PREFIX + body;
+}
+
+/*
+*  static bool read_record(Wal w, uint64_t *sequence, WalKind *kind, char **tokens, size_t *count):
+*
+*  Reads the record at the file position into the record buffer and
+*  checks it.
+*
+*  @param w: The log.
+*  @param sequence: Out parameter receiving the sequence number.
+*  @param kind: Out parameter receiving the kind.
+*  @param tokens: Out parameter receiving WAL_MAX_TOKENS token pointers.
+*  @param count: Out parameter receiving the number of tokens.
+*  @return: Returns false at the end of the log or at a damaged record.
+*/
+static bool read_record(Wal w, uint64_t *sequence, WalKind *kind, char **tokens, size_t *count){
+
+    uint32_t prefix[2];
+    if (fread(prefix, sizeof(uint32_t), 2, w->file) != 2) {
+        return false;
+    }
+
+    uint32_t length = prefix[0];
+    if (length < BODY_FIXED || length > WAL_MAX_RECORD || !reserve(w, length)) {
+        return false;
+    }
+
+    if (fread(w->buffer, 1, length, w->file) != length || crc32(w->buffer, length) != prefix[1]) {
+        return false;
+    }
+
+    memcpy(sequence, w->buffer, sizeof(*sequence));
+    *kind = (WalKind)w->buffer[sizeof(*sequence)];
+    *count = w->buffer[sizeof(*sequence) + 1];
+    if ((*kind != WAL_COMMAND && *kind != WAL_CHECKPOINT) || *count > WAL_MAX_TOKENS) {
+        return false;
+    }
+
+    // every token must end inside the record
+    char *p = (char *)w->buffer + BODY_FIXED;
+    char *end = (char *)w->buffer + length;
+    for (size_t i = 0; i < *count; ++i) {
+        char *terminator = memchr(p, '\0', (size_t)(end - p));
+        if (terminator == NULL) {
+            return false;
+        }
+        tokens[i] = p;
+        p = terminator + 1;
+    }
+
+    return p == end;
+}
+
+/*
+*  static bool write_header(FILE *file, uint64_t id):
+*
+*  @param file: A new, empty log file.
+*  @param id: The log's ID.
+*  @return: Returns true if the header was written.
+*/
+static bool write_header(FILE *file, uint64_t id){
+
+    file_header head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, WAL_MAGIC, sizeof(head.magic));
+    head.version = WAL_VERSION;
+    head.id = id;
+
+    return fwrite(&head, sizeof(head), 1, file) == 1;
+}
+
+/*
+*  static bool sync_file(FILE *file):
+*
+*  @param file: A log file.
+*  @return: Returns true once everything written to the file is on disk.
+*/
+static bool sync_file(FILE *file){
+    return fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
+
+/*
+*  static bool commit(Wal w):
+*
+*  Syncs the waiting records.  The caller holds the lock.
+*
+*  @param w: The log.
+*  @return: Returns false if the log could not be synced.
+*/
+static bool commit(Wal w){
+
+    if (w->pending == 0) {
+        return true;
+    }
+
+    if (!sync_file(w->file)) {
+        return false;
+    }
+
+    w->pending = 0;
+    return true;
+}
+
+/*
+*  static void *flush_late(void *arg):
+*
+*  The flusher: sleeps until the oldest waiting record has waited the
+*  group window, and syncs the group if it is still waiting then.  A
+*  sync that fails is left for the next append or commit to retry and
+*  report.
+*
+*  @param arg: The log.
+*  @return: Returns NULL once the log is closing.
+*/
+static void *flush_late(void *arg){
+
+    Wal w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->closing) {
+        if (w->pending == 0) {
+            pthread_cond_wait(&w->waiting, &w->lock);
+            continue;
+        }
+
+        struct timespec due = w->oldest;
+        due.tv_sec += w->group_ms / 1000;
+        due.tv_nsec += (long)(w->group_ms % 1000) * 1000000;
+        if (due.tv_nsec >= 1000000000) {
+            due.tv_sec++;
+            due.tv_nsec -= 1000000000;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec < due.tv_sec || (now.tv_sec == due.tv_sec && now.tv_nsec < due.tv_nsec)) {
+            pthread_cond_timedwait(&w->waiting, &w->lock, &due);
+        } else if (!commit(w)) {
+            pthread_cond_wait(&w->waiting, &w->lock);
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+/*
+*  struct wal_open:
+*
+*  Opens the log for reading and appending.  An empty file is given a
+*  header, and a fresh ID from the clock and the process ID.
+*
+*  @param path: The log file.
+*  @param reason: Out parameter describing a failure.
+*  @return: Returns the log, or NULL on failure.
+*/
+Wal wal_open(const char *path, const char **reason){
+
+    Wal w = calloc(1, sizeof(wal));
+    if (w != NULL) {
+        w->path = malloc(strlen(path) + 1);
+    }
+    if (w == NULL || w->path == NULL) {
+        *reason = strerror(ENOMEM);
+        free(w);
+        return NULL;
+    }
+    strcpy(w->path, path);
+    w->group_records = WAL_GROUP_RECORDS;
+    w->group_ms = WAL_GROUP_MS;
+    pthread_mutex_init(&w->lock, NULL);
+
+    // the flusher's deadlines come from the same clock as oldest
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&w->waiting, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    w->file = fopen(path, "a+b");
+    if (w->file == NULL) {
+        *reason = strerror(errno);
+        wal_close(w);
+        return NULL;
+    }
+
+    file_header head;
+    rewind(w->file);
+    size_t got = fread(&head, 1, sizeof(head), w->file);
+
+    if (got == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        w->id = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 16);
+
+        if (!write_header(w->file, w->id) || !sync_file(w->file)) {
+            *reason = strerror(errno);
+            wal_close(w);
+            return NULL;
+        }
+    } else if (got != sizeof(head) || memcmp(head.magic, WAL_MAGIC, sizeof(head.magic)) != 0) {
+        *reason = "not an amici log";
+        wal_close(w);
+        return NULL;
+    } else if (head.version != WAL_VERSION) {
+        *reason = "unsupported log version";
+        wal_close(w);
+        return NULL;
+    } else {
+        w->id = head.id;
+    }
+
+    return w;
+}
+
+/*
+*  struct wal_recover:
+*
+*  Scans the log once to find the last good record and the last
+*  checkpoint, cuts off anything after the last good record, then reads
+*  again from just after the checkpoint to hand out the commands.
+*
+*  @param w: The log.
+*  @param checkpoint: Function given the last checkpoint's image.
+*  @param command: Function given each later command.
+*  @param arg: Passed through to both functions.
+*  @param reason: Out parameter describing a failure.
+*  @return: Returns the number of commands replayed, or -1.
+*/
+long wal_recover(Wal w, bool (*checkpoint)(const char *image, void *arg),
+        void (*command)(uint64_t sequence, char **tokens, size_t count, void *arg),
+        void *arg, const char **reason){
+
+    uint64_t sequence;
+    WalKind kind;
+    char *tokens[WAL_MAX_TOKENS];
+    size_t count;
+
+    long good_end = (long)sizeof(file_header);
+    long replay_from = good_end;
+    long last_checkpoint = -1;
+
+    if (fseek(w->file, good_end, SEEK_SET) != 0) {
+        *reason = strerror(errno);
+        return -1;
+    }
+
+    while (read_record(w, &sequence, &kind, tokens, &count)) {
+        // a gap in the numbering is damage too
+        if (w->sequence != 0 && sequence != w->sequence + 1) {
+            break;
+        }
+        w->sequence = sequence;
+
+        if (kind == WAL_CHECKPOINT) {
+            last_checkpoint = good_end;
+        }
+        good_end = ftell(w->file);
+        if (kind == WAL_CHECKPOINT) {
+            replay_from = good_end;
+        }
+    }
+
+    fflush(w->file);
+    if (ftruncate(fileno(w->file), good_end) != 0) {
+        *reason = strerror(errno);
+        return -1;
+    }
+
+    if (last_checkpoint >= 0) {
+        fseek(w->file, last_checkpoint, SEEK_SET);
+        if (!read_record(w, &sequence, &kind, tokens, &count) || count != 1) {
+            *reason = "log checkpoint is damaged";
+            return -1;
+        }
+        if (!checkpoint(tokens[0], arg)) {
+            *reason = "checkpoint image could not be loaded";
+            return -1;
+        }
+    }
+
+    long replayed = 0;
+    fseek(w->file, replay_from, SEEK_SET);
+    while (ftell(w->file) < good_end && read_record(w, &sequence, &kind, tokens, &count)) {
+        if (kind == WAL_COMMAND) {
+            command(sequence, tokens, count, arg);
+            replayed++;
+        }
+    }
+
+    // appends go to the end whatever the position, but a stream must be
+    // repositioned between reading and writing
+    fseek(w->file, 0, SEEK_END);
+
+    w->flushing = pthread_create(&w->flusher, NULL, flush_late, w) == 0;
+    if (!w->flushing) {
+        *reason = "cannot start the log's flusher";
+        return -1;
+    }
+
+    return replayed;
+}
+
+/*
+*  struct wal_append:
+*
+*  Writes the record and syncs if the group is full or its oldest record
+*  has waited long enough.
+*
+*  @param w: The log.
+*  @param kind: The kind of record.
+*  @param tokens: The record's tokens.
+*  @param count: The number of tokens.
+*  @return: Returns false if the record could not be written or synced.
+*/
+bool wal_append(Wal w, WalKind kind, char *const *tokens, size_t count){
+
+    pthread_mutex_lock(&w->lock);
+
+    size_t size = encode(w, w->sequence + 1, kind, tokens, count);
+    if (size == 0 || fwrite(w->buffer, 1, size, w->file) != size) {
+        pthread_mutex_unlock(&w->lock);
+        return false;
+    }
+
+    w->sequence++;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (w->pending++ == 0) {
+        w->oldest = now;
+        pthread_cond_signal(&w->waiting);
+    }
+
+    long waited = (long)(now.tv_sec - w->oldest.tv_sec) * 1000
+            + (now.tv_nsec - w->oldest.tv_nsec) / 1000000;
+
+    bool ok = true;
+    if (w->pending >= w->group_records || waited >= (long)w->group_ms) {
+        ok = commit(w);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+
+    return ok;
+}
+
+/*
+*  struct wal_commit:
+*
+*  @param w: The log.
+*  @return: Returns false if the log could not be synced.
+*/
+bool wal_commit(Wal w){
+
+    pthread_mutex_lock(&w->lock);
+    bool ok = commit(w);
+    pthread_mutex_unlock(&w->lock);
+
+    return ok;
+}
+
+/*
+*  struct wal_checkpoint:
+*
+*  Writes the new log beside the old one, syncs it, and renames it over
+*  the old one, so a crash leaves one log or the other.
+*
+*  @param w: The log.
+*  @param image: The path of the saved image.
+*  @param reason: Out parameter describing a failure.
+*  @return: Returns false if the log is unchanged.
+*/
+bool wal_checkpoint(Wal w, const char *image, const char **reason){
+
+    size_t path_length = strlen(w->path);
+    char *temp = malloc(path_length + sizeof(".tmp"));
+    if (temp == NULL) {
+        *reason = strerror(ENOMEM);
+        return false;
+    }
+    memcpy(temp, w->path, path_length);
+    memcpy(temp + path_length, ".tmp", sizeof(".tmp"));
+
+    pthread_mutex_lock(&w->lock);
+
+    char *tokens[1] = { (char *)image };
+    size_t size = encode(w, w->sequence + 1, WAL_CHECKPOINT, tokens, 1);
+
+    FILE *file = fopen(temp, "a+b");
+    bool ok = file != NULL && ftruncate(fileno(file), 0) == 0 && size > 0
+            && write_header(file, w->id) && fwrite(w->buffer, 1, size, file) == size
+            && sync_file(file);
+
+    *reason = ok ? NULL : (size == 0 ? "image path is too long" : strerror(errno));
+
+    if (ok && rename(temp, w->path) != 0) {
+        *reason = strerror(errno);
+        ok = false;
+    }
+
+    if (!ok) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        remove(temp);
+        free(temp);
+        pthread_mutex_unlock(&w->lock);
+        return false;
+    }
+
+    free(temp);
+
+    fclose(w->file);
+    w->file = file;
+    fseek(w->file, 0, SEEK_END);
+    w->sequence++;
+    w->pending = 0;
+
+    pthread_mutex_unlock(&w->lock);
+
+    return true;
+}
+
+/*
+*  struct wal_set_group:
+*
+*  @param w: The log.
+*  @param records: Records that may wait to be synced.
+*  @param ms: Milliseconds a record may wait to be synced.
+*/
+void wal_set_group(Wal w, size_t records, unsigned ms){
+    pthread_mutex_lock(&w->lock);
+    w->group_records = records > 0 ? records : 1;
+    w->group_ms = ms;
+    pthread_cond_signal(&w->waiting);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/*
+*  struct wal_id:
+*
+*  @param w: The log.
+*  @return: Returns the log's ID.
+*/
+uint64_t wal_id(const Wal w){
+    return w->id;
+}
+
+/*
+*  struct wal_sequence:
+*
+*  @param w: The log.
+*  @return: Returns the last record's sequence number.
+*/
+uint64_t wal_sequence(const Wal w){
+
+    pthread_mutex_lock(&w->lock);
+    uint64_t sequence = w->sequence;
+    pthread_mutex_unlock(&w->lock);
+
+    return sequence;
+}
+
+/*
+*  struct wal_close:
+*
+*  @param w: The log to be closed.
+*/
+void wal_close(Wal w){
+
+    if (w == NULL) {
+        return;
+    }
+
+    if (w->flushing) {
+        pthread_mutex_lock(&w->lock);
+        w->closing = true;
+        pthread_cond_signal(&w->waiting);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->flusher, NULL);
+    }
+
+    if (w->file != NULL) {
+        commit(w);
+        fclose(w->file);
+    }
+
+    pthread_cond_destroy(&w->waiting);
+    pthread_mutex_destroy(&w->lock);
+    free(w->buffer);
+    free(w->path);
+    free(w);
+}
@@ -0,0 +1,157 @@
+/// \file Wal.h
+/// \brief An append-only write-ahead log of commands, with group commit.
+///
+/// @author Connor Patterson
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint64_t
+#include <stdbool.h>    // bool
+
+/// Default number of records appended before the log is synced
+#define WAL_GROUP_RECORDS 64
+
+/// Default number of milliseconds a record may wait to be synced
+#define WAL_GROUP_MS 10
+
+/// Most tokens a record holds
+#define WAL_MAX_TOKENS 4
+
+///
+/// General Notes on log Operation
+///
+/// - Every record carries a sequence number, one more than the record
+///   before it, and a checksum.  Recovery stops at the first record that
+///   is torn or damaged and cuts the log there, so a crash mid-append
+///   loses only that record.
+///
+/// - Records are written to the log file as they are appended but synced
+///   in groups: once WAL_GROUP_RECORDS are waiting, or the oldest has
+///   waited WAL_GROUP_MS, or the client calls wal_commit().  A group of
+///   1 record syncs every append.  A thread the log starts on recovery
+///   syncs a group whose time is up even if nothing more is appended.
+///
+/// - A checkpoint record names a saved image that holds everything
+///   logged before it.  wal_checkpoint() replaces the log with a new one
+///   that starts with the checkpoint, so the log only ever holds what
+///   happened since the last image.
+///
+/// - Every log has a random ID.  An image saved while a log is open can
+///   be stamped with the log's ID and last sequence number, so recovery
+///   can tell which records an image already contains.
+///
+/// - Once recovered, a log may be appended to, committed and read from
+///   several threads at once; records are numbered in the order their
+///   appends take the log's lock.
+///
+
+///
+/// The kinds of record.
+///
+typedef enum {
+    WAL_COMMAND,        ///< a command and its arguments
+    WAL_CHECKPOINT      ///< the path of a saved image
+} WalKind;
+
+///
+/// The Wal data type is a pointer to an opaque structure.
+///
+typedef struct wal_s *Wal;
+
+///
+/// Open a log, creating an empty one if the file does not exist.
+///
+/// @param path The log file
+/// @param reason Set to a description of the failure, if there is one
+///
+/// @return The log, ready for wal_recover(), or NULL
+///
+Wal wal_open( const char *path, const char **reason );
+
+///
+/// Read the log back: hand the last checkpoint to checkpoint, then every
+/// command after it, in order, to command.  Anything after the last good
+/// record is cut off.  Must be called once, before the first append.
+///
+/// @param w The log
+/// @param checkpoint Called with the image path of the last checkpoint,
+///                   if there is one; returns false to abandon recovery
+/// @param command Called with each later command's sequence number and
+///                tokens
+/// @param arg Passed through to both functions
+/// @param reason Set to a description of the failure, if there is one
+///
+/// @return The number of commands handed to command, or -1 on failure
+///
+long wal_recover( Wal w, bool (*checkpoint)( const char *image, void *arg ),
+    void (*command)( uint64_t sequence, char **tokens, size_t count, void *arg ),
+    void *arg, const char **reason );
+
+///
+/// Append a record, syncing the log if this completes a group.
+///
+/// @param w The log
+/// @param kind The kind of record
+/// @param tokens The record's tokens, each a C string
+/// @param count The number of tokens, at most WAL_MAX_TOKENS
+///
+/// @return false if the log could not be written
+///
+bool wal_append( Wal w, WalKind kind, char *const *tokens, size_t count );
+
+///
+/// Sync every record appended so far.
+///
+/// @param w The log
+///
+/// @return false if the log could not be synced
+///
+bool wal_commit( Wal w );
+
+///
+/// Replace the log with one holding only a checkpoint of image.  The
+/// image must already be saved and synced.
+///
+/// @param w The log
+/// @param image The path of the image
+/// @param reason Set to a description of the failure, if there is one
+///
+/// @return false if the log could not be replaced; it is then unchanged
+///
+bool wal_checkpoint( Wal w, const char *image, const char **reason );
+
+///
+/// Set the group commit window.
+///
+/// @param w The log
+/// @param records Records that may wait to be synced (at least 1)
+/// @param ms Milliseconds a record may wait to be synced
+///
+void wal_set_group( Wal w, size_t records, unsigned ms );
+
+///
+/// @param w The log
+///
+/// @return The log's ID
+///
+uint64_t wal_id( const Wal w );
+
+///
+/// @param w The log
+///
+/// @return The sequence number of the last record, 0 for none
+///
+uint64_t wal_sequence( const Wal w );
+
+///
+/// Sync and close the log.
+///
+/// @param w The log to close, or NULL
+///
+/// @post w is not a valid instance of log.
+///
+void wal_close( Wal w );
+
+#endif // WAL_H
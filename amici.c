@@ -7,66 +7,588 @@
 * Author: Connor Patterson
 */
 
+#define _XOPEN_SOURCE 700
+
 #include "HashADT.h"
+#include "Arena.h"
+#include "FriendSet.h"
+#include "Graph.h"
+#include "Loader.h"
+#include "Image.h"
+#include "Wal.h"
+#include "Pool.h"
+#include "Server.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
 #define UNUSED(x) (void)(x)
 
+// entries shown by "dump <bucket>" when no count is given
+#define DUMP_PAGE_SIZE 50
+
+// lines of a data file read at a time by a parallel batch
+#define BATCH_WINDOW 4096
+
+// suggestions shown by "suggest <handle>" when no count is given
+#define SUGGEST_DEFAULT 10
+
+// most friends of one friend that suggest walks through
+#define SUGGEST_FANOUT 1024
+
+// the scratch count of a person suggest must not rank
+#define SUGGEST_EXCLUDED UINT32_MAX
+
+// people listed by "stats top" when no count is given
+#define STATS_TOP_DEFAULT 10
+
+// vertex ranges a triangle count is split into for each thread, so that
+// threads finishing early have ranges left to steal
+#define TRIANGLE_RANGES 16
 
-char *strdup(const char *str);
 
 int num_accounts = 0;
 int num_friendships = 0;
 
+// Every person, their name and handle, and their friends array live here
+Arena amici_arena = NULL;
+
+// The image mapped by the last load.  The people it loaded keep their
+// name, handle and (until it first grows) friends array in the mapping.
+Image amici_image = NULL;
+
+// The write-ahead log, when amici was started with one.  Every mutating 
+// command is appended to it before it runs.
+Wal amici_wal = NULL;
+
+// Where a command's output and errors go: the reply of the connection it
+// came from while serving, buffers of its own in a parallel batch, 
+// otherwise stdout and stderr
+__thread FILE *amici_out = NULL;
+__thread FILE *amici_err = NULL;
+#define OUT (amici_out != NULL ? amici_out : stdout)
+#define ERR (amici_err != NULL ? amici_err : stderr)
+
+// While serving or running a parallel batch, print, size, friend and
+// unfriend share network_lock and lock the shards of the people they
+// touch, so commands on different people run in parallel; every other
+// command holds network_lock alone.
+// Taking network_turnstile first keeps a stream of shared commands from
+// starving the others.
+pthread_rwlock_t network_lock;
+pthread_mutex_t network_turnstile;
+pthread_mutex_t *shard_locks = NULL;
+size_t shard_count = 0;
+
 // Struct representation of a person in Amici
 typedef struct person_s {
     char *name;                 
     char *handle;              
-    struct person_s **friends;  
+    uint32_t id;                // the person's slot in people
+    uint32_t *friends;          // friends' IDs
     size_t friend_count;        
     size_t max_friends;         
+    FriendSet friend_index;     // friends' positions, once friend_count reaches FRIENDSET_THRESHOLD
 } person_t;
 
+// The person table: every person by ID.  IDs are dense, and the ID of a
+// removed person is handed to the next person added.
+person_t **people = NULL;
+uint32_t people_capacity = 0;
+uint32_t people_used = 0;       // IDs handed out so far, removed or not
+uint32_t *free_ids = NULL;      // removed people's IDs, reused last in first out
+uint32_t free_count = 0;
+
+// Who is connected to whom, as a union-find forest over person IDs kept 
+// alongside the person table.  friend merges components as it goes; 
+// unfriend and remove may split one, which only marks the forest stale, 
+// and the next community or components query rebuilds it once.  friend 
+// and unfriend can run in parallel, so they hold components_lock.
+uint32_t *component_parents = NULL;
+uint32_t *component_sizes = NULL;   // a root's component size
+uint32_t *component_firsts = NULL;  // the lowest ID in a root's component, which names it
+size_t component_count = 0;
+size_t component_histogram[32];     // components by size, bucket b holding sizes 2^b .. 2^(b+1)-1
+bool components_stale = false;
+pthread_mutex_t components_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// How many friends everyone has, updated on every change so stats never
+// scans the network: a histogram with a bucket for no friends and one 
+// for each power of two, and a max-heap of person IDs by friend count 
+// (ties to the lower ID) with each person's place in it.  The heap keeps
+// its own copy of each count, so comparing two entries never leaves the 
+// heap.  friend and unfriend change counts in parallel, so they update 
+// both under degrees_lock.
+typedef struct degree_entry_s {
+    uint32_t count;
+    uint32_t id;
+} degree_entry_t;
+
+size_t degree_histogram[33];        // bucket 0 holds no friends, bucket b+1 holds 2^b .. 2^(b+1)-1
+degree_entry_t *degree_heap = NULL;
+uint32_t *degree_places = NULL;     // a person's index in degree_heap
+size_t degree_heap_count = 0;
+pthread_mutex_t degrees_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The CSR snapshot analytical commands read.  It is rebuilt before a
+// query once more than snapshot_drift friend/unfriend changes have been
+// made since it was taken (0 keeps it exact), and dropped by remove and
+// init since those free IDs.
+Graph amici_graph = NULL;
+size_t snapshot_changes = 0;
+size_t snapshot_drift = 0;
+
+// Scratch kept between suggest queries, indexed by person ID: how many 
+// friends each candidate shares (SUGGEST_EXCLUDED for the person asking
+// and their friends), and the IDs whose count is in use, so only those
+// are reset
+uint32_t *suggest_counts = NULL;
+uint32_t *suggest_touched = NULL;
+size_t suggest_capacity = 0;
+
+// Scratch kept between distance queries, indexed by person ID: which 
+// search last reached each person (distance_epoch for the one from the 
+// first person, distance_epoch + 1 for the one from the second), whom 
+// from and at what depth, and each search's queue
+uint32_t *distance_stamps = NULL;
+uint32_t *distance_parents = NULL;
+uint32_t *distance_depths = NULL;
+uint32_t *distance_queues[2] = { NULL, NULL };
+size_t distance_capacity = 0;
+uint32_t distance_epoch = 0;
+
+// Threads for analytical queries, started by the first query that needs
+// them.  They are kept apart from a parallel batch's pool, whose threads
+// may be the ones running the query.
+Pool analysis_pool = NULL;
+size_t analysis_threads = 0;
+
+// A person suggest might rank, and how many friends they share
+typedef struct suggestion_s {
+    const person_t *person;
+    uint32_t mutual;
+} suggestion_t;
+
+// A triangle count in progress: the snapshot with each friendship kept 
+// only at the end with the lower rank (fewer friends, or the lower ID on
+// a tie), so every triangle is seen from exactly one corner, and the 
+// vertex ranges the count is split into, with what each range found
+typedef struct triangle_count_s {
+    const size_t *starts;           // vertex v's higher-ranked neighbours are targets[starts[v] .. starts[v+1]-1]
+    const uint32_t *targets;
+    const uint32_t *range_starts;   // range r covers vertices range_starts[r] .. range_starts[r+1]-1
+    uint64_t *found;
+} triangle_count_t;
+
 
 /*
-*  (person_t initializePerson(const char *name, const char *handle))
+*  (void reservePeople(size_t count))
 *
-*  Initializes a new person with the given name and handle, allocating 
-*  memory for the person structure and duplicating name and handle strings.
+*  Grows the person table (and its free list, which can never hold more 
+*  IDs than the table) to hold at least count people.
 *  
-*  @param name: The name of the person.
-*  @param handle: The handle or username of the person.
-*  @return: A pointer to the newly initialized person.
+*  @param count: The number of people the table must hold.
 */
-person_t *initializePerson(const char *name, const char *handle) {
-    person_t *newPerson = (person_t *)malloc(sizeof(person_t));
-    if (newPerson == NULL) {
-        perror("Memory allocation error"); 
-        exit(EXIT_FAILURE);
+void reservePeople(size_t count) {
+    if (count <= people_capacity) {
+        return;
     }
 
-    newPerson->name = strdup(name);
-    newPerson->handle = strdup(handle);
+    // the top ID is FRIENDSET_EMPTY, which can never name a person
+    assert(count < UINT32_MAX);
 
-    if (newPerson->name == NULL || newPerson->handle == NULL) {
-        perror("Memory allocation error"); 
-        exit(EXIT_FAILURE);
+    size_t capacity = people_capacity == 0 ? 16 : people_capacity;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    if (capacity >= UINT32_MAX) {
+        capacity = UINT32_MAX - 1;
+    }
+
+    people = realloc(people, capacity * sizeof(person_t *));
+    free_ids = realloc(free_ids, capacity * sizeof(uint32_t));
+    component_parents = realloc(component_parents, capacity * sizeof(uint32_t));
+    component_sizes = realloc(component_sizes, capacity * sizeof(uint32_t));
+    component_firsts = realloc(component_firsts, capacity * sizeof(uint32_t));
+    degree_heap = realloc(degree_heap, capacity * sizeof(degree_entry_t));
+    degree_places = realloc(degree_places, capacity * sizeof(uint32_t));
+    assert(people != NULL && free_ids != NULL && component_parents != NULL && component_sizes != NULL);
+    assert(component_firsts != NULL);
+    assert(degree_heap != NULL && degree_places != NULL);
+
+    people_capacity = (uint32_t)capacity;
+}
+
+/*
+*  (void tallyComponent(uint32_t size, int change))
+*
+*  Adds or takes away a component of some size in the component count 
+*  and size histogram.
+*  
+*  @param size: The component's size.
+*  @param change: 1 for a new component, -1 for one that is gone.
+*/
+void tallyComponent(uint32_t size, int change) {
+    component_count += change;
+    component_histogram[31 - __builtin_clz(size)] += change;
+}
+
+/*
+*  (void newComponent(uint32_t id))
+*
+*  Gives a person a component of their own.
+*  
+*  @param id: The person's ID.
+*/
+void newComponent(uint32_t id) {
+    component_parents[id] = id;
+    component_sizes[id] = 1;
+    component_firsts[id] = id;
+    tallyComponent(1, 1);
+}
+
+/*
+*  (uint32_t findComponent(uint32_t id))
+*
+*  Finds the root of a person's component, pointing every person on the
+*  way at their grandparent so later finds take fewer steps.
+*  
+*  @param id: The person's ID.
+*  @return: The ID of the component's root.
+*/
+uint32_t findComponent(uint32_t id) {
+    while (component_parents[id] != id) {
+        component_parents[id] = component_parents[component_parents[id]];
+        id = component_parents[id];
+    }
+
+    return id;
+}
+
+/*
+*  (void joinComponents(uint32_t a, uint32_t b))
+*
+*  Merges the components of two people, hanging the smaller one under 
+*  the root of the larger.  Which root survives depends on the order of
+*  the merges, so a component is named by its lowest ID instead.
+*  
+*  @param a: A person's ID.
+*  @param b: A person's ID.
+*/
+void joinComponents(uint32_t a, uint32_t b) {
+    a = findComponent(a);
+    b = findComponent(b);
+    if (a == b) {
+        return;
+    }
+
+    if (component_sizes[a] < component_sizes[b]) {
+        uint32_t swap = a;
+        a = b;
+        b = swap;
+    }
+
+    tallyComponent(component_sizes[a], -1);
+    tallyComponent(component_sizes[b], -1);
+    component_parents[b] = a;
+    component_sizes[a] += component_sizes[b];
+    if (component_firsts[b] < component_firsts[a]) {
+        component_firsts[a] = component_firsts[b];
+    }
+    tallyComponent(component_sizes[a], 1);
+}
+
+/*
+*  (void rebuildComponents(void))
+*
+*  Rebuilds the components from every friendship, if an unfriend or 
+*  remove may have split one since they were last built.
+*/
+void rebuildComponents(void) {
+    if (!components_stale) {
+        return;
+    }
+
+    component_count = 0;
+    memset(component_histogram, 0, sizeof(component_histogram));
+
+    for (uint32_t id = 0; id < people_used; ++id) {
+        if (people[id] != NULL) {
+            newComponent(id);
+        }
+    }
+
+    for (uint32_t id = 0; id < people_used; ++id) {
+        const person_t *person = people[id];
+        for (size_t i = 0; person != NULL && i < person->friend_count; ++i) {
+            if (person->friends[i] > id) {
+                joinComponents(id, person->friends[i]);
+            }
+        }
+    }
+
+    components_stale = false;
+}
+
+/*
+*  (int degreeBucket(size_t degree))
+*
+*  @param degree: A friend count.
+*  @return: The degree histogram bucket counting it.
+*/
+int degreeBucket(size_t degree) {
+    return degree == 0 ? 0 : 32 - __builtin_clz((unsigned)degree);
+}
+
+/*
+*  (bool leads(degree_entry_t a, degree_entry_t b))
+*
+*  @param a: An entry of the degree heap.
+*  @param b: Another.
+*  @return: True if a belongs above b: more friends, or as many and a 
+*           lower ID.
+*/
+bool leads(degree_entry_t a, degree_entry_t b) {
+    return a.count > b.count || (a.count == b.count && a.id < b.id);
+}
+
+/*
+*  (void placeDegree(size_t place, degree_entry_t entry))
+*
+*  Puts a person's entry at a place in the degree heap and records it.
+*  
+*  @param place: The index in the heap.
+*  @param entry: The entry.
+*/
+void placeDegree(size_t place, degree_entry_t entry) {
+    degree_heap[place] = entry;
+    degree_places[entry.id] = place;
+}
+
+/*
+*  (void siftDegree(size_t place))
+*
+*  Moves the entry at a place in the degree heap up past everyone it 
+*  leads, or down below everyone who leads it, after its count moved.
+*  
+*  @param place: The index in the heap.
+*/
+void siftDegree(size_t place) {
+    degree_entry_t entry = degree_heap[place];
+    size_t start = place;
+
+    while (place > 0 && leads(entry, degree_heap[(place - 1) / 2])) {
+        placeDegree(place, degree_heap[(place - 1) / 2]);
+        place = (place - 1) / 2;
+    }
+
+    // an entry that rose leads everything below it already
+    while (place == start) {
+        size_t child = 2 * place + 1;
+        if (child >= degree_heap_count) {
+            break;
+        }
+        if (child + 1 < degree_heap_count && leads(degree_heap[child + 1], degree_heap[child])) {
+            child++;
+        }
+        if (!leads(degree_heap[child], entry)) {
+            break;
+        }
+        placeDegree(place, degree_heap[child]);
+        place = start = child;
+    }
+
+    placeDegree(place, entry);
+}
+
+/*
+*  (void addDegree(uint32_t id, size_t count))
+*
+*  Adds a person to the degree histogram and heap.
+*  
+*  @param id: The person's ID.
+*  @param count: Their friend count.
+*/
+void addDegree(uint32_t id, size_t count) {
+    degree_entry_t entry = { (uint32_t)count, id };
+
+    degree_histogram[degreeBucket(count)]++;
+    placeDegree(degree_heap_count++, entry);
+    siftDegree(degree_heap_count - 1);
+}
+
+/*
+*  (void changeDegree(const person_t *person))
+*
+*  Moves a person whose friend count changed to its new histogram bucket 
+*  and place in the degree heap.  friend and unfriend call this from 
+*  several threads at once.
+*  
+*  @param person: The person, with their new friend count.
+*/
+void changeDegree(const person_t *person) {
+    pthread_mutex_lock(&degrees_lock);
+
+    size_t place = degree_places[person->id];
+    degree_histogram[degreeBucket(degree_heap[place].count)]--;
+    degree_histogram[degreeBucket(person->friend_count)]++;
+    degree_heap[place].count = person->friend_count;
+    siftDegree(place);
+
+    pthread_mutex_unlock(&degrees_lock);
+}
+
+/*
+*  (void rebuildDegrees(void))
+*
+*  Rebuilds the degree histogram and heap from every person in the 
+*  person table, for a network that was loaded whole.
+*/
+void rebuildDegrees(void) {
+    memset(degree_histogram, 0, sizeof(degree_histogram));
+    degree_heap_count = 0;
+
+    for (uint32_t id = 0; id < people_used; ++id) {
+        if (people[id] != NULL) {
+            addDegree(id, people[id]->friend_count);
+        }
+    }
+}
+
+/*
+*  (void registerPerson(person_t *person))
+*
+*  Gives a person an ID, reusing a removed person's ID when there is one,
+*  and records them in the person table, in a component of their own, 
+*  and in the degree heap.
+*  
+*  @param person: The person to be registered.
+*/
+void registerPerson(person_t *person) {
+    if (free_count > 0) {
+        person->id = free_ids[--free_count];
+    } else {
+        reservePeople((size_t)people_used + 1);
+        person->id = people_used++;
+    }
+
+    people[person->id] = person;
+    newComponent(person->id);
+
+    addDegree(person->id, 0);
+}
+
+/*
+*  (void unregisterPerson(person_t *person))
+*
+*  Removes a person from the person table and the degree heap, and frees
+*  their ID for reuse.
+*  
+*  @param person: The person to be unregistered.
+*/
+void unregisterPerson(person_t *person) {
+    people[person->id] = NULL;
+    free_ids[free_count++] = person->id;
+    components_stale = true;
+
+    // the last person in the heap takes the leaver's place
+    size_t place = degree_places[person->id];
+    degree_histogram[degreeBucket(degree_heap[place].count)]--;
+    if (--degree_heap_count > place) {
+        placeDegree(place, degree_heap[degree_heap_count]);
+        siftDegree(place);
     }
+}
+
+
+/*
+*  (size_t personSize(size_t name_length, size_t handle_length))
+*
+*  Computes the size of the single arena block holding a person record
+*  followed by its name and handle strings.
+*  
+*  @param name_length: The length of the name, without its terminator.
+*  @param handle_length: The length of the handle, without its terminator.
+*  @return: The number of bytes in the block.
+*/
+size_t personSize(size_t name_length, size_t handle_length) {
+    return sizeof(person_t) + name_length + 1 + handle_length + 1;
+}
+
+/*
+*  (person_t initializePerson(const char *first, const char *last, const char *handle))
+*
+*  Initializes a new person with the given name and handle in one arena 
+*  block: the person structure, then the full name ("first last") built 
+*  directly in place, then the handle.
+*  
+*  @param first: The first name of the person.
+*  @param last: The last name of the person.
+*  @param handle: The handle or username of the person.
+*  @return: A pointer to the newly initialized person.
+*/
+person_t *initializePerson(const char *first, const char *last, const char *handle) {
+    size_t first_length = strlen(first);
+    size_t last_length = strlen(last);
+    size_t handle_length = strlen(handle);
+
+    person_t *newPerson = arena_alloc(amici_arena, 
+            personSize(first_length + 1 + last_length, handle_length));
+
+    newPerson->name = (char *)(newPerson + 1);
+    memcpy(newPerson->name, first, first_length);
+    newPerson->name[first_length] = ' ';
+    memcpy(newPerson->name + first_length + 1, last, last_length + 1);
+
+    newPerson->handle = newPerson->name + first_length + 1 + last_length + 1;
+    memcpy(newPerson->handle, handle, handle_length + 1);
 
     newPerson->friends = NULL;
     newPerson->friend_count = 0;
     newPerson->max_friends = 0;
+    newPerson->friend_index = NULL;
 
     return newPerson;
 }
 
+/*
+*  (void freePerson(person_t *person))
+*
+*  Hands a person's block (with their name and handle) and friends array 
+*  back to the arena for reuse.  The person must already have been 
+*  unlinked from every friend.  A person loaded from an image has only 
+*  the person structure in the arena; their strings, and perhaps their 
+*  friends array, belong to the image.
+*  
+*  @param person: The person to be freed.
+*/
+void freePerson(person_t *person) {
+    fs_destroy(person->friend_index);
+
+    if (!image_contains(amici_image, person->friends)) {
+        arena_free(amici_arena, person->friends, person->max_friends * sizeof(uint32_t));
+    }
+
+    if (person->name == (char *)(person + 1)) {
+        arena_free(amici_arena, person, personSize(strlen(person->name), strlen(person->handle)));
+    } else {
+        arena_free(amici_arena, person, sizeof(person_t));
+    }
+}
+
 /*
 *  (size_t findFriendIndex(person_t *person, person_t *friend))
 *
-*  Finds the index of a friend within the person's friends array.
+*  Finds the index of a friend within the person's friends array.  A 
+*  person with an index answers in expected O(1); anyone else has few 
+*  enough friends that a scan is cheaper.
 *  
 *  @param person: The person whose friends are being searched.
 *  @param friend: The friend whose index is to be found.
@@ -74,8 +596,12 @@ person_t *initializePerson(const char *name, const char *handle) {
 *           or SIZE_MAX if the friend is not found.
 */
 size_t findFriendIndex(person_t *person, person_t *friend) {
+    if (person->friend_index != NULL) {
+        return fs_find(person->friend_index, friend->id);
+    }
+
     for (size_t i = 0; i < person->friend_count; ++i) {
-        if (person->friends[i] == friend) {
+        if (person->friends[i] == friend->id) {
             return i;
         }
     }
@@ -86,6 +612,7 @@ size_t findFriendIndex(person_t *person, person_t *friend) {
 *  (void addFriend(person_t *person, person_t *friend))
 *
 *  Adds a friend to the person's friends array. Resizes the array if necessary.
+*  The array gets an index once it reaches FRIENDSET_THRESHOLD friends.
 *  
 *  @param person: The person to whom the friend is being added.
 *  @param friend: The person being added as a friend.
@@ -95,36 +622,141 @@ void addFriend(person_t *person, person_t *friend) {
     // check if the friend array needs resizing
     if (person->friend_count == person->max_friends) {
         size_t new_size = person->max_friends == 0 ? 1 : 2 * person->max_friends;
-        person->friends = (person_t **)realloc(person->friends, new_size * sizeof(person_t *));
-        if (person->friends == NULL) {
-            perror("Memory allocation error");
-            exit(EXIT_FAILURE);
+        uint32_t *friends = arena_alloc(amici_arena, new_size * sizeof(uint32_t));
+        if (person->friends != NULL) {
+            memcpy(friends, person->friends, person->friend_count * sizeof(uint32_t));
+            if (!image_contains(amici_image, person->friends)) {
+                arena_free(amici_arena, person->friends, person->max_friends * sizeof(uint32_t));
+            }
         }
+        person->friends = friends;
         person->max_friends = new_size;
     }
 
-    person->friends[person->friend_count++] = friend;
+    person->friends[person->friend_count] = friend->id;
+
+    if (person->friend_index != NULL) {
+        fs_put(person->friend_index, friend->id, person->friend_count);
+    } else if (person->friend_count + 1 == FRIENDSET_THRESHOLD) {
+        person->friend_index = fs_create(amici_arena, FRIENDSET_THRESHOLD);
+        for (size_t i = 0; i <= person->friend_count; ++i) {
+            fs_put(person->friend_index, person->friends[i], i);
+        }
+    }
+
+    person->friend_count++;
+    changeDegree(person);
 }
 
 /*
-*  (void unfriend(person_t *person, person_t *enemy))
+*  (bool unfriend(person_t *person, person_t *enemy))
 *
-*  Removes a friend (enemy) from the person's friends array.
+*  Removes a friend (enemy) from the person's friends array by moving the 
+*  last friend into its place.  The index is dropped again once the 
+*  person is down to half the threshold, so it is not rebuilt by every 
+*  friend/unfriend pair at the boundary.
 *  
 *  @param person: The person from whom the friend is being removed.
 *  @param enemy: The person being unfriended.
+*  @return: false if the enemy was not the person's friend.
 */
-void unfriend(person_t *person, person_t *enemy){
+bool unfriend(person_t *person, person_t *enemy){
 
     size_t enemy_index = findFriendIndex(person, enemy);;
 
     if (enemy_index != SIZE_MAX) {
-        person->friends[enemy_index] = person->friends[person->friend_count - 1];
+        pthread_mutex_lock(&components_lock);
+        components_stale = true;
+        pthread_mutex_unlock(&components_lock);
+
+        uint32_t moved = person->friends[person->friend_count - 1];
+        person->friends[enemy_index] = moved;
 
         --person->friend_count;
+
+        if (person->friend_index != NULL) {
+            if (person->friend_count < FRIENDSET_THRESHOLD / 2) {
+                fs_destroy(person->friend_index);
+                person->friend_index = NULL;
+            } else {
+                fs_remove(person->friend_index, enemy->id);
+                if (moved != enemy->id) {
+                    fs_put(person->friend_index, moved, enemy_index);
+                }
+            }
+        }
+
+        changeDegree(person);
     } else {
-            return;
+            return false;
+    }
+
+    return true;
+}
+
+/*
+*  (size_t friendsRow(uint32_t id, const uint32_t **neighbours, void *arg))
+*
+*  Hands the friends of the person with the given ID to graph_build.
+*  
+*  @param id: The ID of a person, who may have been removed.
+*  @param neighbours: Set to the person's friends array.
+*  @param arg: Unused.
+*  @return: The person's friend count, 0 for a removed person.
+*/
+size_t friendsRow(uint32_t id, const uint32_t **neighbours, void *arg) {
+    UNUSED(arg);
+
+    if (people[id] == NULL) {
+        *neighbours = NULL;
+        return 0;
+    }
+
+    *neighbours = people[id]->friends;
+    return people[id]->friend_count;
+}
+
+/*
+*  (Graph takeSnapshot(void))
+*
+*  Freezes the current friendships into a new CSR snapshot, replacing 
+*  the old one.
+*  
+*  @return: The new snapshot.
+*/
+Graph takeSnapshot(void) {
+    graph_destroy(amici_graph);
+    amici_graph = graph_build(people_used, friendsRow, NULL);
+    snapshot_changes = 0;
+
+    return amici_graph;
+}
+
+/*
+*  (Graph currentSnapshot(void))
+*
+*  Returns the snapshot for an analytical query, rebuilding it first if 
+*  there is none or the live graph has drifted too far from it.
+*  
+*  @return: A snapshot no more than snapshot_drift changes behind.
+*/
+Graph currentSnapshot(void) {
+    if (amici_graph == NULL || snapshot_changes > snapshot_drift) {
+        return takeSnapshot();
     }
+
+    return amici_graph;
+}
+
+/*
+*  (void dropSnapshot(void))
+*
+*  Discards the snapshot, for changes that can make it point at people 
+*  who no longer exist.
+*/
+void dropSnapshot(void) {
+    graph_destroy(amici_graph);
+    amici_graph = NULL;
 }
 
 /*
@@ -158,37 +790,19 @@ bool equals(const void *key1, const void *key2) {
     return strcmp((const char *)key1, (const char *)key2) == 0;
 }
 
-/*
-*  (void delete(void *key, void *value))
-*
-*  Placeholder function for key-value deletion in the hash table. 
-*  Uses UNUSED macro.
-*  
-*  @param key: The key to be deleted.
-*  @param value: The associated value to be deleted.
-*/
-void delete(void *key, void *value) {
-    UNUSED(key);    // use of UNUSED macro because I did not 
-    UNUSED(value);  
-}
 
 /*
 *  (void print(const void *key, const void *value))
 *
-*  Placeholder function for printing key-value pairs in the hash table. 
-*  Uses UNUSED macro.
+*  Prints one entry of the hash table as "handle (name)", for dump.  
+*  Only the person's own record is touched, never their friends.
 *  
-*  @param key: The key to be printed.
-*  @param value: The associated value to be printed.
+*  @param key: The key (handle) to be printed.
+*  @param value: The person stored under that handle.
 */
 void print(const void *key, const void *value) {
-    UNUSED(key);
-    UNUSED(value);
-    // I realized near the end that I was a different method to print
-    // the people within amici so got rid of this method  
-    // instead (printAmici)
-
-    // I have in processCommand what I would have here
+    const person_t *person = value;
+    fprintf(OUT, "%s (%s)", (const char *)key, person->name);
 }
 
 /*
@@ -199,10 +813,11 @@ void print(const void *key, const void *value) {
 *  @param person: The person whose details are to be printed.
 */
 void printAmici(person_t *person) {
-    printf("%s (%s) has %zu friends\n", person->handle, person->name, person->friend_count);
+    fprintf(OUT, "%s (%s) has %zu friends\n", person->handle, person->name, person->friend_count);
 
     for (size_t i = 0; i < person->friend_count; ++i) {
-        printf("  →  %s (%s)\n", person->friends[i]->handle, person->friends[i]->name);
+        const person_t *friend = people[person->friends[i]];
+        fprintf(OUT, "  →  %s (%s)\n", friend->handle, friend->name);
     }
 }
 
@@ -217,203 +832,2170 @@ void printAmici(person_t *person) {
 */
 void printFriendCount(const char *handle, const char *name, size_t friendCount) {
     if (friendCount == 0) {
-        printf("%s (%s) has no friends\n", handle, name);
+        fprintf(OUT, "%s (%s) has no friends\n", handle, name);
     } else {
-        printf("%s (%s) has %zu friend%s\n", handle, name, friendCount, (friendCount == 1) ? "" : "s");
+        fprintf(OUT, "%s (%s) has %zu friend%s\n", handle, name, friendCount, (friendCount == 1) ? "" : "s");
     }
 }
 
 /*
-*  (void processCommand(HashADT amici_table, char *command, char *arg1, char *arg2, char *arg3))
+*  (void printMutualFriends(const person_t *first, const person_t *second, bool list))
 *
-*  Processes the given command along with its arguments and performs the corresponding actions 
-*  in the social media system.
+*  Prints how many friends two people share and, if asked, who they are
+*  in ID order.  The shared friends are found by intersecting the two 
+*  people's sorted rows of the snapshot.
 *  
-*  @param amici_table: The hash table storing the people in the social media system.
-*  @param command: The command to be processed (add, print, friend, unfriend, size, 
-*                  stats, init, quit).
-*  @param arg1: The first argument associated with the command.
-*  @param arg2: The second argument associated with the command.
-*  @param arg3: The third argument associated with the command.
+*  @param first: The first person.
+*  @param second: The second person.
+*  @param list: Whether to print each shared friend, or only the count.
 */
-void processCommand(HashADT amici_table, char *command, char *arg1, char *arg2, char *arg3) {
+void printMutualFriends(const person_t *first, const person_t *second, bool list) {
+    Graph graph = currentSnapshot();
+
+    size_t first_degree, second_degree;
+    const uint32_t *first_row = graph_neighbours(graph, first->id, &first_degree);
+    const uint32_t *second_row = graph_neighbours(graph, second->id, &second_degree);
+
+    uint32_t *shared = NULL;
+    size_t room = first_degree < second_degree ? first_degree : second_degree;
+    if (list && room > 0) {
+        shared = malloc(room * sizeof(uint32_t));
+        assert(shared != NULL);
+    }
 
-    /* 
-    // Prints out each argument for debug usage
+    size_t count = graph_intersect(first_row, first_degree, second_row, second_degree, shared);
 
-    printf("Debug: Processing command - Command: %s", command);
+    if (count == 0) {
+        fprintf(OUT, "%s (%s) and %s (%s) have no mutual friends\n", first->handle, first->name, 
+                second->handle, second->name);
+    } else {
+        fprintf(OUT, "%s (%s) and %s (%s) have %zu mutual friend%s\n", first->handle, first->name, 
+                second->handle, second->name, count, count == 1 ? "" : "s");
+    }
 
-    if (arg1[0] != '\0') {
-        printf(", Arg1: %s", arg1);
+    for (size_t i = 0; shared != NULL && i < count; ++i) {
+        const person_t *friend = people[shared[i]];
+        fprintf(OUT, "  →  %s (%s)\n", friend->handle, friend->name);
     }
 
-    if (arg2[0] != '\0') {
-        printf(", Arg2: %s", arg2);
+    free(shared);
+}
+
+/*
+*  (void reserveSuggestScratch(void))
+*
+*  Grows the suggest scratch to cover every person ID, zeroing the new 
+*  counts.
+*/
+void reserveSuggestScratch(void) {
+    if (people_used <= suggest_capacity) {
+        return;
     }
 
-    if (arg3[0] != '\0') {
-        printf(", Arg3: %s", arg3);
+    uint32_t *counts = realloc(suggest_counts, people_capacity * sizeof(uint32_t));
+    uint32_t *touched = realloc(suggest_touched, people_capacity * sizeof(uint32_t));
+    assert(counts != NULL && touched != NULL);
+
+    memset(counts + suggest_capacity, 0, (people_capacity - suggest_capacity) * sizeof(uint32_t));
+    suggest_counts = counts;
+    suggest_touched = touched;
+    suggest_capacity = people_capacity;
+}
+
+/*
+*  (bool ranksBelow(const suggestion_t *a, const suggestion_t *b))
+*
+*  Orders suggestions: fewer mutual friends ranks lower, and between
+*  equal counts the later handle does.
+*  
+*  @param a: A suggestion.
+*  @param b: A suggestion.
+*  @return: True if a ranks below b.
+*/
+bool ranksBelow(const suggestion_t *a, const suggestion_t *b) {
+    if (a->mutual != b->mutual) {
+        return a->mutual < b->mutual;
     }
-    */
 
-    printf("\n");
-   
-    if (strcmp(command, "add") == 0) {
-        if (arg1[0] == '\0' || arg2[0] == '\0' || arg3[0] == '\0') {
-            fprintf(stderr, "error: add command requires three arguments\n");
-            return;
-        }
+    return strcmp(a->person->handle, b->person->handle) > 0;
+}
 
-        const person_t *existing_person = ht_get(amici_table, arg3);
-        if (existing_person != NULL) {
-            fprintf(stderr, "error: handle \"%s\" is already in use\n", arg3);
+/*
+*  (void siftSuggestion(suggestion_t *heap, size_t count, size_t i))
+*
+*  Moves a suggestion down a heap whose root is its lowest ranked entry,
+*  until it ranks below neither child.
+*  
+*  @param heap: The heap.
+*  @param count: The number of entries in the heap.
+*  @param i: The entry to move.
+*/
+void siftSuggestion(suggestion_t *heap, size_t count, size_t i) {
+    for (;;) {
+        size_t lowest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < count && ranksBelow(&heap[left], &heap[lowest])) {
+            lowest = left;
+        }
+        if (right < count && ranksBelow(&heap[right], &heap[lowest])) {
+            lowest = right;
+        }
+        if (lowest == i) {
             return;
         }
 
-        num_accounts ++;
-        char *full_name = malloc(strlen(arg1) + strlen(arg2) + 2);
-        strcpy(full_name, arg1);
-        strcat(full_name, " ");
-        strcat(full_name, arg2);
+        suggestion_t swap = heap[i];
+        heap[i] = heap[lowest];
+        heap[lowest] = swap;
+        i = lowest;
+    }
+}
+
+/*
+*  (void printSuggestions(const person_t *person, size_t k))
+*
+*  Prints the k people sharing the most friends with a person who are 
+*  not their friends yet, best first.  Friends of friends are counted in
+*  the scratch counts, reset entry by entry afterwards, and the best k 
+*  are kept in a heap of k entries.  A friend with more than 
+*  SUGGEST_FANOUT friends only has their first SUGGEST_FANOUT counted.
+*  
+*  @param person: The person.
+*  @param k: The most suggestions to print.
+*/
+void printSuggestions(const person_t *person, size_t k) {
+    reserveSuggestScratch();
+
+    // the person and their friends are never suggested
+    size_t touched = 0;
+    suggest_counts[person->id] = SUGGEST_EXCLUDED;
+    suggest_touched[touched++] = person->id;
+    for (size_t i = 0; i < person->friend_count; ++i) {
+        suggest_counts[person->friends[i]] = SUGGEST_EXCLUDED;
+        suggest_touched[touched++] = person->friends[i];
+    }
+
+    for (size_t i = 0; i < person->friend_count; ++i) {
+        const person_t *friend = people[person->friends[i]];
+        size_t fanout = friend->friend_count < SUGGEST_FANOUT ? friend->friend_count : SUGGEST_FANOUT;
+
+        for (size_t j = 0; j < fanout; ++j) {
+            uint32_t id = friend->friends[j];
+            if (suggest_counts[id] == SUGGEST_EXCLUDED) {
+                continue;
+            }
+            if (suggest_counts[id] == 0) {
+                suggest_touched[touched++] = id;
+            }
+            suggest_counts[id]++;
+        }
+    }
+
+    size_t candidates = touched - 1 - person->friend_count;
+    size_t room = k < candidates ? k : candidates;
+    suggestion_t *heap = malloc((room > 0 ? room : 1) * sizeof(suggestion_t));
+    assert(heap != NULL);
+
+    size_t count = 0;
+    for (size_t i = 0; i < touched; ++i) {
+        uint32_t id = suggest_touched[i];
+        suggestion_t candidate = { people[id], suggest_counts[id] };
+        suggest_counts[id] = 0;
+
+        if (candidate.mutual == SUGGEST_EXCLUDED || room == 0) {
+            continue;
+        }
+
+        if (count < room) {
+            // sift the new entry up past every parent ranking above it
+            size_t j = count++;
+            while (j > 0 && ranksBelow(&candidate, &heap[(j - 1) / 2])) {
+                heap[j] = heap[(j - 1) / 2];
+                j = (j - 1) / 2;
+            }
+            heap[j] = candidate;
+        } else if (ranksBelow(&heap[0], &candidate)) {
+            heap[0] = candidate;
+            siftSuggestion(heap, count, 0);
+        }
+    }
+
+    // taking the lowest ranked entry off to the end each time leaves 
+    // the heap sorted best first
+    for (size_t end = count; end > 1; --end) {
+        suggestion_t swap = heap[0];
+        heap[0] = heap[end - 1];
+        heap[end - 1] = swap;
+        siftSuggestion(heap, end - 1, 0);
+    }
+
+    if (count == 0) {
+        fprintf(OUT, "%s (%s) has no suggestions\n", person->handle, person->name);
+    } else {
+        fprintf(OUT, "%s (%s) has %zu suggestion%s\n", person->handle, person->name, count, 
+                count == 1 ? "" : "s");
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        fprintf(OUT, "  →  %s (%s), %u mutual friend%s\n", heap[i].person->handle, heap[i].person->name,
+                heap[i].mutual, heap[i].mutual == 1 ? "" : "s");
+    }
+
+    free(heap);
+}
+
+/*
+*  (void reserveDistanceScratch(void))
+*
+*  Grows the distance scratch to cover every person ID.  New stamps are
+*  zeroed, which no search uses.
+*/
+void reserveDistanceScratch(void) {
+    if (people_used <= distance_capacity) {
+        return;
+    }
+
+    uint32_t *stamps = realloc(distance_stamps, people_capacity * sizeof(uint32_t));
+    uint32_t *parents = realloc(distance_parents, people_capacity * sizeof(uint32_t));
+    uint32_t *depths = realloc(distance_depths, people_capacity * sizeof(uint32_t));
+    uint32_t *queue0 = realloc(distance_queues[0], people_capacity * sizeof(uint32_t));
+    uint32_t *queue1 = realloc(distance_queues[1], people_capacity * sizeof(uint32_t));
+    assert(stamps != NULL && parents != NULL && depths != NULL && queue0 != NULL && queue1 != NULL);
+
+    memset(stamps + distance_capacity, 0, (people_capacity - distance_capacity) * sizeof(uint32_t));
+    distance_stamps = stamps;
+    distance_parents = parents;
+    distance_depths = depths;
+    distance_queues[0] = queue0;
+    distance_queues[1] = queue1;
+    distance_capacity = people_capacity;
+}
+
+/*
+*  (void printDistance(const person_t *from, const person_t *to, bool path))
+*
+*  Prints the fewest friendships linking two people, and if asked the 
+*  people along one such chain.  Searches run from both ends at once, a
+*  whole level at a time, always growing the side with the smaller 
+*  frontier; once the sides meet, the rest of that level is checked for
+*  a shorter meeting before stopping.  A person is marked as reached by
+*  a side by stamping them with the query's epoch (plus the side), so 
+*  no per-query clearing is needed.
+*  
+*  @param from: The person the chain starts at.
+*  @param to: The person the chain ends at.
+*  @param path: Whether to print the chain.
+*/
+void printDistance(const person_t *from, const person_t *to, bool path) {
+    reserveDistanceScratch();
+
+    // stamps are epoch for the side from "from" and epoch + 1 for the side
+    // from "to"; when they run out, every stamp is cleared once
+    if (distance_epoch >= UINT32_MAX - 2) {
+        memset(distance_stamps, 0, distance_capacity * sizeof(uint32_t));
+        distance_epoch = 0;
+    }
+    distance_epoch += 2;
+
+    size_t head[2] = { 0, 0 };
+    size_t tail[2] = { 1, 1 };
+    uint32_t level[2] = { 0, 0 };
+    const person_t *ends[2] = { from, to };
+
+    for (int side = 0; side < 2; ++side) {
+        uint32_t id = ends[side]->id;
+        distance_stamps[id] = distance_epoch + side;
+        distance_parents[id] = UINT32_MAX;
+        distance_depths[id] = 0;
+        distance_queues[side][0] = id;
+    }
+
+    // the best meeting so far: meet[side] is where that side's half ends
+    uint32_t best = from == to ? 0 : UINT32_MAX;
+    uint32_t meet[2] = { from->id, to->id };
+
+    while (best == UINT32_MAX && head[0] < tail[0] && head[1] < tail[1]) {
+        int side = tail[0] - head[0] <= tail[1] - head[1] ? 0 : 1;
+        uint32_t mine = distance_epoch + side;
+        uint32_t theirs = distance_epoch + 1 - side;
+        size_t end = tail[side];
+
+        for (size_t q = head[side]; q < end; ++q) {
+            uint32_t id = distance_queues[side][q];
+            const person_t *person = people[id];
+
+            for (size_t i = 0; i < person->friend_count; ++i) {
+                uint32_t friend = person->friends[i];
+
+                if (distance_stamps[friend] == theirs) {
+                    uint32_t length = level[side] + 1 + distance_depths[friend];
+                    if (length < best) {
+                        best = length;
+                        meet[side] = id;
+                        meet[1 - side] = friend;
+                    }
+                } else if (distance_stamps[friend] != mine) {
+                    distance_stamps[friend] = mine;
+                    distance_parents[friend] = id;
+                    distance_depths[friend] = level[side] + 1;
+                    distance_queues[side][tail[side]++] = friend;
+                }
+            }
+        }
+
+        head[side] = end;
+        level[side]++;
+    }
+
+    if (best == UINT32_MAX) {
+        fprintf(OUT, "%s (%s) and %s (%s) are not connected\n", from->handle, from->name, 
+                to->handle, to->name);
+        return;
+    }
+
+    fprintf(OUT, "%s (%s) and %s (%s) are %u step%s apart\n", from->handle, from->name, 
+            to->handle, to->name, best, best == 1 ? "" : "s");
+
+    if (!path) {
+        return;
+    }
+
+    // walk from the meeting back to "from", reusing a queue to reverse 
+    // that half, then on to "to"
+    uint32_t *chain = distance_queues[0];
+    size_t length = 0;
+    for (uint32_t id = meet[0]; id != UINT32_MAX; id = distance_parents[id]) {
+        chain[length++] = id;
+    }
+    while (length > 0) {
+        const person_t *person = people[chain[--length]];
+        fprintf(OUT, "  →  %s (%s)\n", person->handle, person->name);
+    }
+    for (uint32_t id = from == to ? UINT32_MAX : meet[1]; id != UINT32_MAX; id = distance_parents[id]) {
+        const person_t *person = people[id];
+        fprintf(OUT, "  →  %s (%s)\n", person->handle, person->name);
+    }
+}
+
+/*
+*  (void printComponents(void))
+*
+*  Prints how many communities the network splits into, and how many 
+*  there are of each size, one line for each power-of-two range of sizes
+*  that has any.
+*/
+void printComponents(void) {
+    rebuildComponents();
+
+    fprintf(OUT, "Communities: %zu\n", component_count);
+
+    for (int b = 0; b < 32; ++b) {
+        if (component_histogram[b] == 0) {
+            continue;
+        }
+
+        unsigned low = 1u << b;
+        if (b == 0) {
+            fprintf(OUT, "  %u: %zu\n", low, component_histogram[b]);
+        } else {
+            fprintf(OUT, "  %u-%u: %zu\n", low, low + (low - 1), component_histogram[b]);
+        }
+    }
+}
+
+/*
+*  (double millisecondsSince(const struct timespec *start))
+*
+*  @param start: A time read from the monotonic clock.
+*  @return: The milliseconds elapsed since then.
+*/
+double millisecondsSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*
+*  (void countTriangleRange(size_t index, void *arg))
+*
+*  Counts the triangles whose lowest-ranked corner is in one vertex 
+*  range, on a pool thread: for each friendship from a vertex up to a 
+*  higher-ranked one, the third corners are the higher-ranked neighbours
+*  the two share.
+*  
+*  @param index: The range.
+*  @param arg: The triangle count.
+*/
+void countTriangleRange(size_t index, void *arg) {
+    triangle_count_t *count = arg;
+    uint64_t found = 0;
+
+    for (uint32_t u = count->range_starts[index]; u < count->range_starts[index + 1]; ++u) {
+        const uint32_t *row = count->targets + count->starts[u];
+        size_t degree = count->starts[u + 1] - count->starts[u];
+
+        for (size_t i = 0; i < degree; ++i) {
+            uint32_t v = row[i];
+            found += graph_intersect(row, degree, count->targets + count->starts[v], 
+                    count->starts[v + 1] - count->starts[v], NULL);
+        }
+    }
+
+    count->found[index] = found;
+}
+
+/*
+*  (uint64_t countTriangles(Graph graph))
+*
+*  Counts every triangle in the snapshot exactly.  Each friendship is 
+*  kept at its lower-ranked end, which leaves no vertex more than about
+*  sqrt(2m) neighbours to intersect, then the vertices are split into 
+*  ranges of about equal work and the ranges run on the analysis pool.
+*  
+*  @param graph: The snapshot.
+*  @return: The number of triangles.
+*/
+uint64_t countTriangles(Graph graph) {
+    uint32_t vertices = graph_vertices(graph);
+    if (vertices == 0) {
+        return 0;
+    }
+
+    if (analysis_pool == NULL) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        analysis_threads = cpus > 0 ? (size_t)cpus : 1;
+        analysis_pool = pool_create(analysis_threads);
+    }
+
+    size_t *starts = malloc((vertices + 1) * sizeof(size_t));
+    uint32_t *targets = malloc((graph_entries(graph) / 2 + 1) * sizeof(uint32_t));
+    assert(starts != NULL && targets != NULL);
+
+    // filtering a row keeps it in ascending order
+    size_t entries = 0;
+    for (uint32_t u = 0; u < vertices; ++u) {
+        size_t degree;
+        const uint32_t *row = graph_neighbours(graph, u, &degree);
+
+        starts[u] = entries;
+        for (size_t i = 0; i < degree; ++i) {
+            size_t other;
+            graph_neighbours(graph, row[i], &other);
+            if (other > degree || (other == degree && row[i] > u)) {
+                targets[entries++] = row[i];
+            }
+        }
+    }
+    starts[vertices] = entries;
+
+    // a vertex's work grows with its kept friendships, plus a little for
+    // visiting it at all
+    size_t ranges = analysis_threads * TRIANGLE_RANGES;
+    uint32_t *range_starts = malloc((ranges + 1) * sizeof(uint32_t));
+    assert(range_starts != NULL);
+
+    size_t work = entries + vertices;
+    size_t built = 0;
+    range_starts[built++] = 0;
+    for (uint32_t u = 0; u < vertices && built < ranges; ++u) {
+        if (starts[u] + u >= built * (work / ranges + 1)) {
+            if (u > range_starts[built - 1]) {
+                range_starts[built++] = u;
+            }
+        }
+    }
+    range_starts[built] = vertices;
+
+    size_t *waits = calloc(built, sizeof(size_t));
+    size_t *next_start = calloc(built + 1, sizeof(size_t));
+    uint64_t *found = calloc(built, sizeof(uint64_t));
+    assert(waits != NULL && next_start != NULL && found != NULL);
+
+    triangle_count_t count = { starts, targets, range_starts, found };
+    pool_run(analysis_pool, built, waits, next_start, NULL, countTriangleRange, &count);
+
+    uint64_t triangles = 0;
+    for (size_t r = 0; r < built; ++r) {
+        triangles += found[r];
+    }
+
+    free(found);
+    free(next_start);
+    free(waits);
+    free(range_starts);
+    free(targets);
+    free(starts);
+
+    return triangles;
+}
+
+/*
+*  (void printTriangles(void))
+*
+*  Prints how many triangles of friends the network holds and its global
+*  clustering coefficient: the share of paths of two friendships whose 
+*  ends are friends too.  The count runs on the snapshot, and its time 
+*  is shown with it.
+*/
+void printTriangles(void) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Graph graph = currentSnapshot();
+    uint64_t triangles = countTriangles(graph);
+
+    uint64_t paths = 0;
+    for (uint32_t v = 0; v < graph_vertices(graph); ++v) {
+        size_t degree;
+        graph_neighbours(graph, v, &degree);
+        if (degree > 1) {
+            paths += (uint64_t)degree * (degree - 1) / 2;
+        }
+    }
+
+    double coefficient = paths == 0 ? 0.0 : 3.0 * triangles / paths;
+
+    fprintf(OUT, "Triangles: %llu, global clustering coefficient %.6f (%.3f ms)\n", 
+            (unsigned long long)triangles, coefficient, millisecondsSince(&start));
+}
+
+/*
+*  (void printClustering(const person_t *person))
+*
+*  Prints a person's clustering coefficient: the share of pairs of their
+*  friends who are friends with each other.  Each pair is found twice, 
+*  once from each friend's row of the snapshot.
+*  
+*  @param person: The person.
+*/
+void printClustering(const person_t *person) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Graph graph = currentSnapshot();
+
+    size_t degree;
+    const uint32_t *row = graph_neighbours(graph, person->id, &degree);
+
+    uint64_t found = 0;
+    for (size_t i = 0; i < degree; ++i) {
+        size_t friend_degree;
+        const uint32_t *friend_row = graph_neighbours(graph, row[i], &friend_degree);
+        found += graph_intersect(row, degree, friend_row, friend_degree, NULL);
+    }
+
+    uint64_t triangles = found / 2;
+    uint64_t pairs = degree < 2 ? 0 : (uint64_t)degree * (degree - 1) / 2;
+    double coefficient = pairs == 0 ? 0.0 : (double)triangles / pairs;
+
+    fprintf(OUT, "%s (%s) has clustering coefficient %.6f, with %llu triangle%s among %zu friend%s (%.3f ms)\n", 
+            person->handle, person->name, coefficient, (unsigned long long)triangles, 
+            triangles == 1 ? "" : "s", degree, degree == 1 ? "" : "s", millisecondsSince(&start));
+}
+
+/*
+*  (void printDegrees(void))
+*
+*  Prints how many people have no friends, and how many have a friend 
+*  count in each power-of-two range that has anyone, from the degree 
+*  histogram.
+*/
+void printDegrees(void) {
+    fprintf(OUT, "Friend counts:\n");
+
+    for (int b = 0; b < 33; ++b) {
+        if (degree_histogram[b] == 0) {
+            continue;
+        }
+
+        if (b <= 1) {
+            fprintf(OUT, "  %d: %zu\n", b, degree_histogram[b]);
+        } else {
+            unsigned low = 1u << (b - 1);
+            fprintf(OUT, "  %u-%u: %zu\n", low, low + (low - 1), degree_histogram[b]);
+        }
+    }
+}
+
+/*
+*  (void printTopFriends(size_t k))
+*
+*  Prints the k people with the most friends, most first.  The degree 
+*  heap's order is only partial, so a second, small heap holds the 
+*  places whose parents have been printed, and the next person printed
+*  is always the leader among them.
+*  
+*  @param k: The most people to print.
+*/
+void printTopFriends(size_t k) {
+    if (k > degree_heap_count) {
+        k = degree_heap_count;
+    }
+
+    fprintf(OUT, "Most friends:\n");
+    if (k == 0) {
+        return;
+    }
+
+    // every place printed adds at most its two children and removes itself
+    size_t *frontier = malloc((k + 1) * sizeof(size_t));
+    assert(frontier != NULL);
+    size_t size = 0;
+    frontier[size++] = 0;
+
+    for (size_t rank = 1; rank <= k; ++rank) {
+        size_t place = frontier[0];
+
+        // pop the leading place, then push its children
+        frontier[0] = frontier[--size];
+        for (size_t i = 0; 2 * i + 1 < size; ) {
+            size_t child = 2 * i + 1;
+            if (child + 1 < size && leads(degree_heap[frontier[child + 1]], degree_heap[frontier[child]])) {
+                child++;
+            }
+            if (!leads(degree_heap[frontier[child]], degree_heap[frontier[i]])) {
+                break;
+            }
+            size_t swap = frontier[i];
+            frontier[i] = frontier[child];
+            frontier[child] = swap;
+            i = child;
+        }
+
+        for (size_t child = 2 * place + 1; child <= 2 * place + 2 && child < degree_heap_count; ++child) {
+            size_t i = size++;
+            frontier[i] = child;
+            while (i > 0 && leads(degree_heap[frontier[i]], degree_heap[frontier[(i - 1) / 2]])) {
+                size_t swap = frontier[i];
+                frontier[i] = frontier[(i - 1) / 2];
+                frontier[(i - 1) / 2] = swap;
+                i = (i - 1) / 2;
+            }
+        }
+
+        const person_t *person = people[degree_heap[place].id];
+        fprintf(OUT, "  %zu. %s (%s) has %zu friend%s\n", rank, person->handle, person->name, 
+                person->friend_count, person->friend_count == 1 ? "" : "s");
+    }
+
+    free(frontier);
+}
+
+/*
+*  (bool logCommand(const char *command, const char *arg1, const char *arg2, const char *arg3))
+*
+*  Appends a command to the write-ahead log, if there is one, once it 
+*  has been checked and just before it changes the network.  Commands 
+*  that fail or change nothing never reach this, so they are not logged.
+*  
+*  @param command: The command.
+*  @param arg1: The first argument, or an empty string.
+*  @param arg2: The second argument, or an empty string.
+*  @param arg3: The third argument, or an empty string.
+*  @return: false if the command must not run because it could not be 
+*           logged.
+*/
+bool logCommand(const char *command, const char *arg1, const char *arg2, const char *arg3) {
+    if (amici_wal == NULL) {
+        return true;
+    }
+
+    // wal_append only reads the tokens
+    char *tokens[WAL_MAX_TOKENS] = { (char *)command, (char *)arg1, (char *)arg2, (char *)arg3 };
+    size_t count = 1;
+    while (count < WAL_MAX_TOKENS && tokens[count][0] != '\0') {
+        count++;
+    }
+
+    if (!wal_append(amici_wal, WAL_COMMAND, tokens, count)) {
+        fprintf(ERR, "error: cannot write to the log: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+*  (void addPerson(HashADT amici_table, const char *first, const char *last, const char *handle))
+*
+*  Carries out the add command: creates a person and registers them 
+*  under their handle, unless the handle is taken.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param first: The first name of the person.
+*  @param last: The last name of the person.
+*  @param handle: The handle of the person.
+*/
+void addPerson(HashADT amici_table, const char *first, const char *last, const char *handle) {
+
+    // one probe both checks the handle and claims its slot
+    bool inserted;
+    HashSlot slot = ht_get_or_insert(amici_table, handle, &inserted);
+    if (!inserted) {
+        fprintf(ERR, "error: handle \"%s\" is already in use\n", handle);
+        return;
+    }
+
+    // the claimed slot still holds the caller's key, so it can be given up
+    if (!logCommand("add", first, last, handle)) {
+        ht_remove(amici_table, handle);
+        return;
+    }
+
+    num_accounts ++;
+
+    person_t *new_person = initializePerson(first, last, handle);
+    registerPerson(new_person);
+    *slot.key = new_person->handle;     // the table owns the person's copy
+    *slot.value = new_person;
+}
+
+/*
+*  (void befriend(HashADT amici_table, const char *handle1, const char *handle2))
+*
+*  Carries out the friend command: makes two people friends, unless one 
+*  of them does not exist or they already are.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param handle1: The handle of the person asking.
+*  @param handle2: The handle of the person being asked.
+*/
+void befriend(HashADT amici_table, const char *handle1, const char *handle2) {
+
+    person_t *requester = ht_find(amici_table, handle1);
+    person_t *receiver = ht_find(amici_table, handle2);
+
+    if (requester == NULL || receiver == NULL) {
+        fprintf(ERR, "error: one or more handles not found\n");
+        return;
+    }
+
+    if (requester == receiver) {
+        fprintf(ERR, "error: %s cannot friend themselves\n", requester->handle);
+        return;
+    }
+
+    // friendship is mutual, so ask whichever side has fewer friends
+    bool already = requester->friend_count <= receiver->friend_count 
+            ? findFriendIndex(requester, receiver) != SIZE_MAX 
+            : findFriendIndex(receiver, requester) != SIZE_MAX;
+
+    if (already) {
+        fprintf(OUT, "%s and %s are already friends\n", requester->handle, receiver->handle);
+        return;
+    }
+
+    if (!logCommand("friend", handle1, handle2, "")) {
+        return;
+    }
+
+    addFriend(requester, receiver);
+    addFriend(receiver, requester);
+
+    pthread_mutex_lock(&components_lock);
+    joinComponents(requester->id, receiver->id);
+    pthread_mutex_unlock(&components_lock);
+
+    fprintf(OUT, "%s and %s are now friends\n", requester->handle, receiver->handle);
+
+    // friend runs in parallel with other friend, unfriend and size commands
+    __atomic_fetch_add(&num_friendships, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&snapshot_changes, 1, __ATOMIC_RELAXED);
+}
+
+/*
+*  (void resetNetwork(HashADT amici_table))
+*
+*  Forgets every person and friendship.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*/
+void resetNetwork(HashADT amici_table) {
+
+    // the arena owns every person, so dropping its chunks releases 
+    // the whole population at once
+    ht_clear(amici_table);
+    arena_reset(amici_arena);
+    people_used = 0;
+    free_count = 0;
+    dropSnapshot();
+
+    image_close(amici_image);
+    amici_image = NULL;
+
+    num_accounts = 0;
+    num_friendships = 0;
+
+    component_count = 0;
+    memset(component_histogram, 0, sizeof(component_histogram));
+    components_stale = false;
+
+    memset(degree_histogram, 0, sizeof(degree_histogram));
+    degree_heap_count = 0;
+}
+
+/*
+*  (bool imageRecord(uint32_t id, ImagePerson *out, void *arg))
+*
+*  Describes the person with the given ID to image_save.
+*  
+*  @param id: A person ID.
+*  @param out: Receives the person's name, handle and friends.
+*  @param arg: Unused.
+*  @return: false if nobody has the ID.
+*/
+bool imageRecord(uint32_t id, ImagePerson *out, void *arg) {
+    UNUSED(arg);
+
+    const person_t *person = people[id];
+    if (person == NULL) {
+        return false;
+    }
+
+    out->name = person->name;
+    out->handle = person->handle;
+    out->friends = person->friends;
+    out->friend_count = person->friend_count;
+
+    return true;
+}
+
+/*
+*  (const char *repeatedHandle(const Image image))
+*
+*  Looks for a handle two people in an image share, in a scratch table,
+*  before anything of the current network is touched.
+*  
+*  @param image: The image.
+*  @return: A handle that appears twice, or NULL if every one is unique.
+*/
+const char *repeatedHandle(const Image image) {
+    HashADT seen = ht_create_with_capacity(hash, equals, print, NULL, image_people(image));
+    const char *repeated = NULL;
+
+    for (uint32_t id = 0; id < image_ids(image) && repeated == NULL; ++id) {
+        ImagePerson stored;
+        if (!image_person(image, id, &stored)) {
+            continue;
+        }
+
+        bool inserted;
+        HashSlot slot = ht_get_or_insert(seen, stored.handle, &inserted);
+        if (!inserted) {
+            repeated = stored.handle;
+        } else {
+            *slot.key = stored.handle;
+            *slot.value = stored.handle;
+        }
+    }
+
+    ht_destroy(seen);
+
+    return repeated;
+}
+
+/*
+*  (void loadImage(HashADT amici_table, const char *path))
+*
+*  Replaces the whole network with the one in an image.  Each person is 
+*  a bare person structure whose name, handle and friends array point 
+*  into the mapped image, so loading touches each person once and copies
+*  no strings or friends lists; only the handle table and the indexes of 
+*  high-degree people are rebuilt.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param path: The image file.
+*  @return: true if the image was loaded; on failure the network is 
+*           unchanged.
+*/
+bool loadImage(HashADT amici_table, const char *path) {
+
+    const char *reason;
+    Image image = image_open(path, &reason);
+    if (image == NULL) {
+        fprintf(ERR, "error: cannot load \"%s\": %s\n", path, reason);
+        return false;
+    }
+
+    const char *repeated = repeatedHandle(image);
+    if (repeated != NULL) {
+        fprintf(ERR, "error: cannot load \"%s\": handle \"%s\" appears twice\n", path, repeated);
+        image_close(image);
+        return false;
+    }
+
+    resetNetwork(amici_table);
+    amici_image = image;
+
+    uint32_t ids = image_ids(image);
+    reservePeople(ids);
+    ht_reserve(amici_table, image_people(image));
+
+    for (uint32_t id = 0; id < ids; ++id) {
+        ImagePerson stored;
+        if (!image_person(image, id, &stored)) {
+            people[id] = NULL;
+            free_ids[free_count++] = id;
+            continue;
+        }
+
+        person_t *person = arena_alloc(amici_arena, sizeof(person_t));
+        person->name = stored.name;
+        person->handle = stored.handle;
+        person->id = id;
+        person->friends = stored.friends;
+        person->friend_count = stored.friend_count;
+        person->max_friends = stored.friend_count;
+        person->friend_index = NULL;
+
+        if (person->friend_count >= FRIENDSET_THRESHOLD) {
+            person->friend_index = fs_create(amici_arena, person->friend_count);
+            for (size_t i = 0; i < person->friend_count; ++i) {
+                fs_put(person->friend_index, person->friends[i], i);
+            }
+        }
+
+        // repeatedHandle() found every handle unique
+        bool inserted;
+        HashSlot slot = ht_get_or_insert(amici_table, person->handle, &inserted);
+        assert(inserted);
+        UNUSED(inserted);
+        *slot.key = person->handle;
+        *slot.value = person;
+
+        people[id] = person;
+        num_accounts ++;
+        num_friendships += (int)person->friend_count;
+    }
+
+    people_used = ids;
+    num_friendships /= 2;
+
+    // the image holds no components; the first query builds them
+    components_stale = true;
+    rebuildDegrees();
+
+    fprintf(OUT, "Loaded %d %s from %s\n", num_accounts, num_accounts == 1 ? "person" : "people", path);
+
+    return true;
+}
+
+/*
+*  (void checkpointLog(const char *image))
+*
+*  Records in the log, if there is one, that the network now matches an
+*  image, which empties the log of everything before it.  The image is 
+*  recorded by its full path, so recovery finds it from any directory.
+*  
+*  @param image: The path of the image.
+*/
+void checkpointLog(const char *image) {
+    if (amici_wal == NULL) {
+        return;
+    }
+
+    const char *reason = NULL;
+    char *full = realpath(image, NULL);
+
+    if (full == NULL || !wal_checkpoint(amici_wal, full, &reason)) {
+        fprintf(ERR, "error: cannot checkpoint the log: %s\n", 
+                reason != NULL ? reason : strerror(errno));
+    }
+
+    free(full);
+}
+
+/*
+*  (void processCommand(HashADT amici_table, char *command, char *arg1, char *arg2, char *arg3))
+*
+*  Processes the given command along with its arguments and performs the corresponding actions 
+*  in the social media system.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param command: The command to be processed (add, remove, print, friend, unfriend,
+*                  size, stats, dump, snapshot, mutual, suggest, distance, community, 
+*                  components, triangles, clustering, save, load, wal, init, quit).
+*  @param arg1: The first argument associated with the command.
+*  @param arg2: The second argument associated with the command.
+*  @param arg3: The third argument associated with the command.
+*/
+void processCommand(HashADT amici_table, char *command, char *arg1, char *arg2, char *arg3) {
+
+    /* 
+    // Prints out each argument for debug usage
+
+    fprintf(OUT, "Debug: Processing command - Command: %s", command);
+
+    if (arg1[0] != '\0') {
+        fprintf(OUT, ", Arg1: %s", arg1);
+    }
+
+    if (arg2[0] != '\0') {
+        fprintf(OUT, ", Arg2: %s", arg2);
+    }
+
+    if (arg3[0] != '\0') {
+        fprintf(OUT, ", Arg3: %s", arg3);
+    }
+    */
+
+    fprintf(OUT, "\n");
+
+    if (strcmp(command, "add") == 0) {
+        if (arg1[0] == '\0' || arg2[0] == '\0' || arg3[0] == '\0') {
+            fprintf(ERR, "error: add command requires three arguments\n");
+            return;
+        }
+
+        addPerson(amici_table, arg1, arg2, arg3);
+
+        return;
+
+    } if (strcmp(command, "remove") == 0) {
+
+        if (arg1[0] == '\0') {
+            fprintf(ERR, "error: remove command requires a handle argument\n");
+            return;
+        }
+
+        person_t *person = ht_find(amici_table, arg1);
+        if (person == NULL) {
+            fprintf(ERR, "error: handle \"%s\" not found\n", arg1);
+            return;
+        }
+
+        if (!logCommand(command, arg1, "", "")) {
+            return;
+        }
+        ht_remove(amici_table, arg1);
+
+        // unlink the person from the other side of every friendship
+        for (size_t i = 0; i < person->friend_count; ++i) {
+            unfriend(people[person->friends[i]], person);
+        }
+
+        num_accounts --;
+        num_friendships -= person->friend_count;
+
+        unregisterPerson(person);
+        freePerson(person);
+        dropSnapshot();
+
+        return;
+
+    } if (strcmp(command, "print")==0){
+
+        if (arg1[0] == '\0') {
+            fprintf(ERR, "error: print command requires a handle argument\n");
+            return;
+        }
+
+        person_t *person = ht_find(amici_table, arg1);
+        if (person == NULL) {
+            fprintf(ERR, "error: handle \"%s\" not found\n", arg1);
+            return;
+        }
+
+        printAmici(person);
+
+        return;
+
+    } if(strcmp(command, "friend")==0){
+
+
+        if (arg1[0] == '\0' || arg2[0] == '\0') {
+            fprintf(ERR, "error: friend command requires two arguments\n");
+            return;
+        }
+
+        befriend(amici_table, arg1, arg2);
+
+        return;
+
+    } if(strcmp(command, "unfriend")==0){
+
+        if (arg1[0] == '\0' || arg2[0] == '\0') {
+            fprintf(ERR, "error: unfriend command requires two arguments\n");
+            return;
+        }
+
+        person_t *requester = ht_find(amici_table, arg1);
+        person_t *receiver = ht_find(amici_table, arg2);
+
+        if (requester == NULL || receiver == NULL) {
+            fprintf(ERR, "error: one or more handles not found\n");
+            return;
+        }
+
+        // people who are not friends leave nothing to log or count
+        if (findFriendIndex(requester, receiver) == SIZE_MAX) {
+            return;
+        }
+
+        if (!logCommand(command, arg1, arg2, "")) {
+            return;
+        }
+
+        // unfriend runs in parallel with other friend, unfriend and size commands
+        unfriend(requester, receiver);
+        unfriend(receiver, requester);
+        __atomic_fetch_sub(&num_friendships, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&snapshot_changes, 1, __ATOMIC_RELAXED);
+
+        return;
+
+    } if(strcmp(command, "size")==0){
+
+        if (arg1[0] == '\0') {
+            fprintf(ERR, "error: size command requires a handle argument\n");
+            return;
+        }
+ 
+        person_t *person = ht_find(amici_table, arg1);
+        
+        if (person == NULL) {
+            fprintf(ERR, "error: handle \"%s\" not found\n", arg1);
+            return;
+        }
+
+        printFriendCount(person->handle, person->name, person->friend_count);
+
+        return;
+
+    } if (strcmp(command, "stats") == 0) {
+
+        // "stats" is the totals alone, "stats degrees" the friend count 
+        // histogram, and "stats top [count]" the people with most friends
+        if (arg1[0] == '\0') {
+            fprintf(OUT, "Statistics: ");
+            fprintf(OUT, "%d %s %d %s\n", num_accounts, num_accounts == 1 ? "person" : "people",num_friendships, 
+            num_friendships == 1 ? "friendship" : "friendships");
+            return;
+        }
+
+        if (strcmp(arg1, "degrees") == 0 && arg2[0] == '\0') {
+            printDegrees();
+            return;
+        }
+
+        char *end;
+        size_t k = STATS_TOP_DEFAULT;
+        bool valid = strcmp(arg1, "top") == 0 && arg3[0] == '\0';
+        if (valid && arg2[0] != '\0') {
+            k = strtoul(arg2, &end, 10);
+            valid = arg2[0] != '-' && *end == '\0' && k > 0;
+        }
+
+        if (!valid) {
+            fprintf(ERR, "error: usage: stats [degrees | top [count]]\n");
+            return;
+        }
+
+        printTopFriends(k);
+
+        return;
+
+    } if (strcmp(command, "dump") == 0) {
+
+        // "dump" is the summary alone, "dump all" streams every entry, 
+        // and "dump <bucket> [count]" shows one page starting at a bucket
+        if (arg1[0] == '\0') {
+            ht_dump(amici_table, false, OUT);
+            return;
+        }
+
+        if (strcmp(arg1, "all") == 0 && arg2[0] == '\0') {
+            ht_dump(amici_table, true, OUT);
+            return;
+        }
+
+        char *end;
+        size_t start = strtoul(arg1, &end, 10);
+        bool valid = arg1[0] != '-' && *end == '\0';
+
+        size_t count = DUMP_PAGE_SIZE;
+        if (valid && arg2[0] != '\0') {
+            count = strtoul(arg2, &end, 10);
+            valid = arg2[0] != '-' && *end == '\0' && count > 0;
+        }
+
+        if (!valid || arg3[0] != '\0') {
+            fprintf(ERR, "error: usage: dump [all | bucket [count]]\n");
+            return;
+        }
+
+        ht_dump(amici_table, false, OUT);
+        size_t next = ht_dump_page(amici_table, start, count, OUT);
+        if (next != 0) {
+            fprintf(OUT, "(more: dump %zu %zu)\n", next, count);
+        }
+
+        return;
+
+    } if (strcmp(command, "snapshot") == 0) {
+
+        // "snapshot" rebuilds now; "snapshot drift <n>" lets queries run 
+        // on a snapshot up to n friend/unfriend changes old
+        if (strcmp(arg1, "drift") == 0) {
+            char *end;
+            size_t drift = strtoul(arg2, &end, 10);
+            if (arg2[0] == '\0' || arg2[0] == '-' || *end != '\0' || arg3[0] != '\0') {
+                fprintf(ERR, "error: usage: snapshot [drift changes]\n");
+                return;
+            }
+
+            snapshot_drift = drift;
+            fprintf(OUT, "Snapshot drift set to %zu\n", drift);
+            return;
+        }
+
+        if (arg1[0] != '\0') {
+            fprintf(ERR, "error: usage: snapshot [drift changes]\n");
+            return;
+        }
+
+        Graph graph = takeSnapshot();
+        size_t friendships = graph_entries(graph) / 2;
+        fprintf(OUT, "Snapshot: %u %s, %zu %s\n", graph_vertices(graph), graph_vertices(graph) == 1 ? "ID" : "IDs",
+                friendships, friendships == 1 ? "friendship" : "friendships");
+
+        return;
+
+    } if (strcmp(command, "mutual") == 0) {
+
+        // "mutual <h1> <h2>" lists the friends two people share, and 
+        // "mutual <h1> <h2> count" only counts them
+        if (arg1[0] == '\0' || arg2[0] == '\0' || (arg3[0] != '\0' && strcmp(arg3, "count") != 0)) {
+            fprintf(ERR, "error: usage: mutual handle1 handle2 [count]\n");
+            return;
+        }
+
+        person_t *first = ht_find(amici_table, arg1);
+        person_t *second = ht_find(amici_table, arg2);
+
+        if (first == NULL || second == NULL) {
+            fprintf(ERR, "error: one or more handles not found\n");
+            return;
+        }
+
+        printMutualFriends(first, second, arg3[0] == '\0');
+
+        return;
+
+    } if (strcmp(command, "suggest") == 0) {
+
+        // "suggest <handle> [k]" ranks the best k people to befriend
+        char *end = NULL;
+        size_t k = SUGGEST_DEFAULT;
+        if (arg2[0] != '\0') {
+            k = strtoul(arg2, &end, 10);
+        }
+
+        if (arg1[0] == '\0' || (end != NULL && (arg2[0] == '-' || *end != '\0' || k == 0)) || arg3[0] != '\0') {
+            fprintf(ERR, "error: usage: suggest handle [count]\n");
+            return;
+        }
+
+        person_t *person = ht_find(amici_table, arg1);
+        if (person == NULL) {
+            fprintf(ERR, "error: handle \"%s\" not found\n", arg1);
+            return;
+        }
+
+        printSuggestions(person, k);
+
+        return;
+
+    } if (strcmp(command, "distance") == 0) {
+
+        // "distance <h1> <h2>" counts the friendships between two people,
+        // and "distance <h1> <h2> path" also names who links them
+        if (arg1[0] == '\0' || arg2[0] == '\0' || (arg3[0] != '\0' && strcmp(arg3, "path") != 0)) {
+            fprintf(ERR, "error: usage: distance handle1 handle2 [path]\n");
+            return;
+        }
+
+        person_t *from = ht_find(amici_table, arg1);
+        person_t *to = ht_find(amici_table, arg2);
+
+        if (from == NULL || to == NULL) {
+            fprintf(ERR, "error: one or more handles not found\n");
+            return;
+        }
+
+        printDistance(from, to, arg3[0] != '\0');
+
+        return;
+
+    } if (strcmp(command, "community") == 0) {
+
+        if (arg1[0] == '\0') {
+            fprintf(ERR, "error: usage: community handle\n");
+            return;
+        }
+
+        person_t *person = ht_find(amici_table, arg1);
+
+        if (person == NULL) {
+            fprintf(ERR, "error: handle \"%s\" not found\n", arg1);
+            return;
+        }
+
+        rebuildComponents();
+
+        uint32_t root = findComponent(person->id);
+        fprintf(OUT, "%s (%s) is in community %u, with %u %s\n", person->handle, person->name, 
+                component_firsts[root], component_sizes[root], component_sizes[root] == 1 ? "person" : "people");
+
+        return;
+
+    } if (strcmp(command, "components") == 0) {
+        printComponents();
+
+        return;
+
+    } if (strcmp(command, "triangles") == 0) {
+        printTriangles();
+
+        return;
+
+    } if (strcmp(command, "clustering") == 0) {
+
+        if (arg1[0] == '\0') {
+            fprintf(ERR, "error: usage: clustering handle\n");
+            return;
+        }
+
+        person_t *person = ht_find(amici_table, arg1);
+
+        if (person == NULL) {
+            fprintf(ERR, "error: handle \"%s\" not found\n", arg1);
+            return;
+        }
+
+        printClustering(person);
+
+        return;
+
+    } if (strcmp(command, "save") == 0) {
+
+        if (arg1[0] == '\0') {
+            fprintf(ERR, "error: save command requires a file argument\n");
+            return;
+        }
+
+        // the image is stamped with the log position it includes, which 
+        // must be durable first: records after a torn tail are reused
+        ImageStamp stamp = { 0, 0 };
+        if (amici_wal != NULL) {
+            if (!wal_commit(amici_wal)) {
+                fprintf(ERR, "error: cannot sync the log: %s\n", strerror(errno));
+                return;
+            }
+            stamp.log = wal_id(amici_wal);
+            stamp.sequence = wal_sequence(amici_wal);
+        }
+
+        const char *reason;
+        if (!image_save(arg1, people_used, imageRecord, NULL, stamp, &reason)) {
+            fprintf(ERR, "error: cannot save \"%s\": %s\n", arg1, reason);
+            return;
+        }
+
+        checkpointLog(arg1);
+
+        fprintf(OUT, "Saved %d %s to %s\n", num_accounts, num_accounts == 1 ? "person" : "people", arg1);
+
+        return;
+
+    } if (strcmp(command, "load") == 0) {
+
+        if (arg1[0] == '\0') {
+            fprintf(ERR, "error: load command requires a file argument\n");
+            return;
+        }
+
+        if (loadImage(amici_table, arg1)) {
+            checkpointLog(arg1);
+        }
+
+        return;
+
+    } if (strcmp(command, "wal") == 0) {
+
+        // "wal" syncs the log now; "wal <records> <ms>" sets the group 
+        // commit window
+        if (amici_wal == NULL) {
+            fprintf(ERR, "error: no log; start amici with -w logfile\n");
+            return;
+        }
+
+        if (arg1[0] == '\0') {
+            if (!wal_commit(amici_wal)) {
+                fprintf(ERR, "error: cannot sync the log: %s\n", strerror(errno));
+                return;
+            }
+            fprintf(OUT, "Log synced through record %llu\n", (unsigned long long)wal_sequence(amici_wal));
+            return;
+        }
+
+        char *end1, *end2;
+        unsigned long records = strtoul(arg1, &end1, 10);
+        unsigned long ms = strtoul(arg2, &end2, 10);
+        if (*end1 != '\0' || arg2[0] == '\0' || *end2 != '\0' || arg1[0] == '-' || arg2[0] == '-' 
+                || records == 0 || ms > UINT32_MAX || arg3[0] != '\0') {
+            fprintf(ERR, "error: usage: wal [records milliseconds]\n");
+            return;
+        }
+
+        wal_set_group(amici_wal, records, (unsigned)ms);
+        fprintf(OUT, "Log synced every %lu record%s or %lu ms\n", records, records == 1 ? "" : "s", ms);
+
+        return;
+
+    } if (strcmp(command, "init") == 0) {
+
+        if (!logCommand(command, "", "", "")) {
+            return;
+        }
+
+        resetNetwork(amici_table);
+
+        fprintf(OUT, "System re-initialized\n");
+
+        return;
+
+    } if (strcmp(command, "quit") == 0) {
+        fprintf(OUT, "Exiting...\n");
+
+        ht_destroy(amici_table);
+        arena_destroy(amici_arena);
+        free(people);
+        free(free_ids);
+        free(suggest_counts);
+        free(suggest_touched);
+        free(distance_stamps);
+        free(distance_parents);
+        free(distance_depths);
+        free(distance_queues[0]);
+        free(distance_queues[1]);
+        free(component_parents);
+        free(component_sizes);
+        free(component_firsts);
+
+        free(degree_heap);
+        free(degree_places);
+        graph_destroy(amici_graph);
+        pool_destroy(analysis_pool);
+        image_close(amici_image);
+        wal_close(amici_wal);
+
+        exit(EXIT_SUCCESS);
+    }
+    else {
+
+        fprintf(ERR, "error: command not recognized\n");
+
+        return;
+    }
+
+}
+
+/*
+*  (size_t countAddCommands(FILE *file))
+*
+*  Counts the add commands in a data file, so the table can be sized for
+*  the whole population before loading and never rehash while it loads.
+*  The file is rewound afterwards.  A stream that cannot be rewound (a 
+*  pipe, say) is left untouched and counts as having no add commands.
+*  
+*  @param file: The data file to be scanned.
+*  @return: The number of lines whose command is add.
+*/
+size_t countAddCommands(FILE *file) {
+    char input[1024];
+    size_t count = 0;
+
+    if (ftell(file) < 0) {
+        return 0;
+    }
+
+    while (fgets(input, sizeof(input), file) != NULL) {
+        const char *command = input + strspn(input, " \t");
+        if (strncmp(command, "add", 3) == 0 && (command[3] == ' ' || command[3] == '\t')) {
+            count ++;
+        }
+    }
+
+    rewind(file);
 
-        person_t *new_person = initializePerson(full_name, arg3);
-        ht_put(amici_table, new_person->handle, new_person);
+    return count;
+}
 
-        free(full_name);
+/*
+*  (void executeLine(HashADT amici_table, const LoaderLine *line))
+*
+*  Runs one line of a mapped data file.  Complete add and friend lines, 
+*  which make up most of a bulk load, go straight to their commands; 
+*  every other line goes through processCommand.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param line: The line's tokens.
+*/
+void executeLine(HashADT amici_table, const LoaderLine *line) {
+    char none[] = "";
+    char *args[LOADER_MAX_TOKENS];
 
+    if (line->count == 0) {
+        fprintf(ERR, "error: Unable to parse input\n");
         return;
+    }
 
-    } if (strcmp(command, "print")==0){
+    for (size_t i = 0; i < LOADER_MAX_TOKENS; ++i) {
+        args[i] = i < line->count ? line->tokens[i].text : none;
+    }
 
-        if (arg1[0] == '\0') {
-            fprintf(stderr, "error: print command requires a handle argument\n");
-            return;
-        }
+    if (line->count == 4 && line->tokens[0].length == 3 && memcmp(args[0], "add", 3) == 0) {
+        fprintf(OUT, "\n");
+        addPerson(amici_table, args[1], args[2], args[3]);
+        return;
+    }
 
-        const person_t *const_person = ht_get(amici_table, arg1);
-        if (const_person == NULL) {
-            fprintf(stderr, "error: handle \"%s\" not found\n", arg1);
-            return;
-        }
+    if (line->count == 3 && line->tokens[0].length == 6 && memcmp(args[0], "friend", 6) == 0) {
+        fprintf(OUT, "\n");
+        befriend(amici_table, args[1], args[2]);
+        return;
+    }
 
-        person_t *person = (person_t *)const_person;
+    processCommand(amici_table, args[0], args[1], args[2], args[3]);
+}
 
-        ht_dump(amici_table, true);
-        printf("\n");
-        printf("\n");
-        printAmici(person);
+// What recovery needs to know while the log is read back
+typedef struct {
+    HashADT table;
+    uint64_t log;               // the log's ID
+    ImageStamp stamp;           // the stamp of the checkpoint image
+    long replayed;              // commands run again
+} recovery_t;
+
+/*
+*  (bool recoverCheckpoint(const char *image, void *arg))
+*
+*  Loads the image named by the log's last checkpoint.
+*  
+*  @param image: The path of the image.
+*  @param arg: The recovery state.
+*  @return: false if the image could not be loaded.
+*/
+bool recoverCheckpoint(const char *image, void *arg) {
+    recovery_t *recovery = arg;
+
+    if (!loadImage(recovery->table, image)) {
+        return false;
+    }
+
+    recovery->stamp = image_stamp(amici_image);
+    return true;
+}
+
+/*
+*  (void recoverCommand(uint64_t sequence, char **tokens, size_t count, void *arg))
+*
+*  Replays one logged command.  A command the checkpoint image already 
+*  includes is skipped; that happens when amici stopped after saving an 
+*  image but before the log was checkpointed.
+*  
+*  @param sequence: The command's sequence number in the log.
+*  @param tokens: The command and its arguments.
+*  @param count: The number of tokens.
+*  @param arg: The recovery state.
+*/
+void recoverCommand(uint64_t sequence, char **tokens, size_t count, void *arg) {
+    recovery_t *recovery = arg;
+    char none[] = "";
+    char *args[WAL_MAX_TOKENS];
 
+    if (recovery->stamp.log == recovery->log && sequence <= recovery->stamp.sequence) {
         return;
+    }
 
-    } if(strcmp(command, "friend")==0){
+    for (size_t i = 0; i < WAL_MAX_TOKENS; ++i) {
+        args[i] = i < count ? tokens[i] : none;
+    }
 
+    processCommand(recovery->table, args[0], args[1], args[2], args[3]);
+    recovery->replayed++;
+}
 
-        if (arg1[0] == '\0' || arg2[0] == '\0') {
-            fprintf(stderr, "error: friend command requires two arguments\n");
-            return;
-        }
+/*
+*  (Wal recoverLog(HashADT amici_table, const char *path))
+*
+*  Opens the write-ahead log and rebuilds the network from it: the image
+*  of its last checkpoint, then every command logged since.  The output 
+*  of the replayed commands was shown when they first ran, so it is 
+*  discarded.  amici cannot run on a network it failed to rebuild, so 
+*  any failure ends the program.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param path: The log file.
+*  @return: The log, ready for appending.
+*/
+Wal recoverLog(HashADT amici_table, const char *path) {
+    const char *reason;
 
-        const person_t *const_requester = ht_get(amici_table, arg1);
-        const person_t *const_receiver = ht_get(amici_table, arg2);
+    Wal wal = wal_open(path, &reason);
+    if (wal == NULL) {
+        fprintf(ERR, "error: cannot open log \"%s\": %s\n", path, reason);
+        exit(EXIT_FAILURE);
+    }
 
-        if (const_requester == NULL || const_receiver == NULL) {
-            fprintf(stderr, "error: one or more handles not found\n");
-            return;
-        }
+    recovery_t recovery = { amici_table, wal_id(wal), { 0, 0 }, 0 };
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(null);
+    }
 
-        person_t *requester = (person_t *)const_requester;
-        person_t *receiver = (person_t *)const_receiver;
+    long logged = wal_recover(wal, recoverCheckpoint, recoverCommand, &recovery, &reason);
 
-        if (findFriendIndex(requester, receiver) != SIZE_MAX) {
-            printf("%s and %s are already friends\n", requester->handle, receiver->handle);
-            return;
-        }
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    if (logged < 0) {
+        fprintf(ERR, "error: cannot recover from log \"%s\": %s\n", path, reason);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(OUT, "Recovered %d %s and %ld logged command%s from %s\n", num_accounts, 
+            num_accounts == 1 ? "person" : "people", recovery.replayed, 
+            recovery.replayed == 1 ? "" : "s", path);
+
+    return wal;
+}
+
+/*
+*  (size_t shardOf(const char *handle))
+*
+*  Picks the shard, and the worker, that commands on a person run on.
+*  
+*  @param handle: The person's handle.
+*  @return: The shard, below shard_count.
+*/
+size_t shardOf(const char *handle) {
+    return hash(handle) % shard_count;
+}
+
+/*
+*  (bool isSharedCommand(const char *command))
+*
+*  @param command: A command.
+*  @return: True for the commands that only touch the people they name,
+*           which hold network_lock shared while serving.
+*/
+bool isSharedCommand(const char *command) {
+    return strcmp(command, "print") == 0 || strcmp(command, "size") == 0 
+            || strcmp(command, "friend") == 0 || strcmp(command, "unfriend") == 0;
+}
+
+/*
+*  (ServerRoute routeCommand(char **tokens, size_t count, size_t *worker, void *arg))
+*
+*  Routes a command from a connection.  A command naming one person, or 
+*  two people in the same shard, runs on that shard's worker alongside 
+*  the connection's other commands; anything else waits for them.  add
+*  and remove wait too, since they take and free person IDs, whose 
+*  order must be the order the commands were sent in.
+*  
+*  @param tokens: The command's tokens.
+*  @param count: The number of tokens.
+*  @param worker: Out parameter receiving the worker to run it on.
+*  @param arg: The hash table storing the people in the social media system.
+*  @return: How the command runs.
+*/
+ServerRoute routeCommand(char **tokens, size_t count, size_t *worker, void *arg) {
+    UNUSED(arg);
+
+    *worker = 0;
+    if (count == 0) {
+        return SERVER_BARRIER;
+    }
+
+    if (strcmp(tokens[0], "quit") == 0) {
+        return SERVER_CLOSE;
+    }
+
+    if (strcmp(tokens[0], "add") == 0 && count == 4) {
+        *worker = shardOf(tokens[3]);
+    }
+
+    if ((strcmp(tokens[0], "print") == 0 || strcmp(tokens[0], "size") == 0) && count >= 2) {
+        *worker = shardOf(tokens[1]);
+        return SERVER_SHARD;
+    }
+
+    if ((strcmp(tokens[0], "friend") == 0 || strcmp(tokens[0], "unfriend") == 0) && count >= 3) {
+        *worker = shardOf(tokens[1]);
+        return *worker == shardOf(tokens[2]) ? SERVER_SHARD : SERVER_BARRIER;
+    }
+
+    if (strcmp(tokens[0], "remove") == 0 && count >= 2) {
+        *worker = shardOf(tokens[1]);
+    }
+
+    return SERVER_BARRIER;
+}
+
+/*
+*  (void processLocked(HashADT amici_table, char **args))
+*
+*  Processes a command while other threads may be processing others, 
+*  holding network_lock shared and the shards of the people it names for
+*  print, size, friend and unfriend, and network_lock alone otherwise.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param args: The command and its three arguments, empty when missing.
+*/
+void processLocked(HashADT amici_table, char **args) {
+    pthread_mutex_lock(&network_turnstile);
 
-        addFriend(requester, receiver);
-        addFriend(receiver, requester);
+    if (!isSharedCommand(args[0])) {
+        pthread_rwlock_wrlock(&network_lock);
+        pthread_mutex_unlock(&network_turnstile);
 
-        printf("%s and %s are now friends\n", requester->handle, receiver->handle);
-        num_friendships ++;
+        processCommand(amici_table, args[0], args[1], args[2], args[3]);
 
+        pthread_rwlock_unlock(&network_lock);
         return;
+    }
 
-    } if(strcmp(command, "unfriend")==0){
+    pthread_rwlock_rdlock(&network_lock);
+    pthread_mutex_unlock(&network_turnstile);
 
-        if (arg1[0] == '\0' || arg2[0] == '\0') {
-            fprintf(stderr, "error: unfriend command requires two arguments\n");
-            return;
+    // lock each named person's shard once, lowest first
+    size_t shards[2];
+    size_t held = 0;
+    for (size_t i = 1; i <= 2 && args[i][0] != '\0'; ++i) {
+        size_t shard = shardOf(args[i]);
+        if (held == 1 && shard == shards[0]) {
+            continue;
         }
+        shards[held++] = shard;
+    }
+    if (held == 2 && shards[1] < shards[0]) {
+        size_t first = shards[1];
+        shards[1] = shards[0];
+        shards[0] = first;
+    }
 
-        const person_t *const_requester = ht_get(amici_table, arg1);
-        const person_t *const_receiver = ht_get(amici_table, arg2);
+    for (size_t i = 0; i < held; ++i) {
+        pthread_mutex_lock(&shard_locks[shards[i]]);
+    }
 
-        if (const_requester == NULL || const_receiver == NULL) {
-            fprintf(stderr, "error: one or more handles not found\n");
-            return;
-        }
+    processCommand(amici_table, args[0], args[1], args[2], args[3]);
 
-        person_t *requester = (person_t *)const_requester;
-        person_t *receiver = (person_t *)const_receiver;
+    for (size_t i = held; i > 0; --i) {
+        pthread_mutex_unlock(&shard_locks[shards[i - 1]]);
+    }
 
-        unfriend(requester, receiver);
-        unfriend(receiver, requester);
+    pthread_rwlock_unlock(&network_lock);
+}
 
-        return;
+/*
+*  (void startSharing(HashADT amici_table, size_t shards))
+*
+*  Prepares the network for commands from several threads: creates the 
+*  locks processLocked takes, stops lookups from migrating the table so
+*  that shared commands never write to it, and makes the arena lock.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param shards: The number of shards.
+*/
+void startSharing(HashADT amici_table, size_t shards) {
+    shard_count = shards;
+    shard_locks = malloc(shard_count * sizeof(pthread_mutex_t));
+    assert(shard_locks != NULL);
+    for (size_t i = 0; i < shard_count; ++i) {
+        pthread_mutex_init(&shard_locks[i], NULL);
+    }
+    pthread_rwlock_init(&network_lock, NULL);
+    pthread_mutex_init(&network_turnstile, NULL);
 
-    } if(strcmp(command, "size")==0){
+    ht_set_incremental(amici_table, 0);
+    arena_set_shared(amici_arena, true);
+}
 
-        if (arg1[0] == '\0') {
-            fprintf(stderr, "error: size command requires a handle argument\n");
-            return;
+/*
+*  (void stopSharing(HashADT amici_table))
+*
+*  Undoes startSharing once a single thread is left.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*/
+void stopSharing(HashADT amici_table) {
+    arena_set_shared(amici_arena, false);
+    ht_set_incremental(amici_table, MIGRATE_STEP);
+
+    pthread_mutex_destroy(&network_turnstile);
+    pthread_rwlock_destroy(&network_lock);
+    for (size_t i = 0; i < shard_count; ++i) {
+        pthread_mutex_destroy(&shard_locks[i]);
+    }
+    free(shard_locks);
+    shard_locks = NULL;
+}
+
+/*
+*  (void serveCommand(char **tokens, size_t count, FILE *reply, void *arg))
+*
+*  Runs a command from a connection on a worker, with its output going 
+*  to the connection's reply.
+*  
+*  @param tokens: The command's tokens.
+*  @param count: The number of tokens.
+*  @param reply: The stream the output goes to.
+*  @param arg: The hash table storing the people in the social media system.
+*/
+void serveCommand(char **tokens, size_t count, FILE *reply, void *arg) {
+    HashADT amici_table = arg;
+    char none[] = "";
+    char *args[SERVER_MAX_TOKENS];
+
+    for (size_t i = 0; i < SERVER_MAX_TOKENS; ++i) {
+        args[i] = i < count ? tokens[i] : none;
+    }
+
+    amici_out = reply;
+    amici_err = reply;
+
+    if (count == 0) {
+        fprintf(ERR, "error: Unable to parse input\n");
+    } else {
+        processLocked(amici_table, args);
+    }
+
+    amici_out = NULL;
+    amici_err = NULL;
+}
+
+/*
+*  (void syncLog(void *arg))
+*
+*  Makes the log durable, if there is one, before replies are sent.
+*  
+*  @param arg: The hash table storing the people in the social media system.
+*/
+void syncLog(void *arg) {
+    UNUSED(arg);
+
+    if (amici_wal != NULL && !wal_commit(amici_wal)) {
+        fprintf(stderr, "error: cannot sync the log: %s\n", strerror(errno));
+    }
+}
+
+/*
+*  (bool serveClients(HashADT amici_table, const char *path, size_t workers))
+*
+*  Serves commands from clients on a Unix domain socket until amici is 
+*  interrupted.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param path: The socket path.
+*  @param workers: The number of worker threads, and of shards.
+*  @return: false if the server could not start.
+*/
+bool serveClients(HashADT amici_table, const char *path, size_t workers) {
+    startSharing(amici_table, workers);
+
+    fprintf(OUT, "Serving on %s with %zu worker%s\n", path, workers, workers == 1 ? "" : "s");
+    fflush(stdout);
+
+    const char *reason;
+    bool served = server_run(path, workers, routeCommand, serveCommand, syncLog, amici_table, &reason);
+    if (!served) {
+        fprintf(ERR, "error: cannot serve on \"%s\": %s\n", path, reason);
+    }
+
+    stopSharing(amici_table);
+
+    return served;
+}
+
+// One line of a data file run in a parallel batch, and its output once
+// it has run.  Lines read from a stream keep their tokens in text; lines
+// of a mapped file point into the mapping.
+typedef struct batch_command_s {
+    char *args[LOADER_MAX_TOKENS];
+    char text[LOADER_MAX_TOKENS][256];
+    bool parsed;                // false for a line with no tokens
+    bool barrier;               // runs alone, straight to stdout and stderr
+    const char *handles[2];     // what orders the command against others
+    size_t handle_count;
+    size_t next[2];             // the commands waiting on this one
+    size_t next_count;
+    char *out;
+    size_t out_length;
+    char *err;
+    size_t err_length;
+} batch_command_t;
+
+// A parallel batch: the commands of the current window, the table 
+// recording the last command on each handle, and the graph handed to 
+// the pool
+typedef struct batch_s {
+    HashADT amici_table;
+    batch_command_t *commands;
+    HashADT last;
+    size_t *waits;
+    size_t *next_start;
+    size_t *next;
+} batch_t;
+
+/*
+*  (bool readBatchCommand(Loader loader, FILE *file, batch_command_t *command))
+*
+*  Reads the next line of a data file, from its mapping if it has one and
+*  otherwise from the stream, splitting it as the serial loops do.
+*  
+*  @param loader: The mapped data file, or NULL.
+*  @param file: The data file's stream, used when loader is NULL.
+*  @param command: Receives the line.
+*  @return: false once every line has been read.
+*/
+bool readBatchCommand(Loader loader, FILE *file, batch_command_t *command) {
+    static char none[] = "";
+
+    if (loader != NULL) {
+        LoaderLine line;
+        if (!loader_next(loader, &line)) {
+            return false;
         }
- 
-        const person_t *const_person = ht_get(amici_table, arg1);
-        
-        if (const_person == NULL) {
-            fprintf(stderr, "error: handle \"%s\" not found\n", arg1);
-            return;
+
+        for (size_t i = 0; i < LOADER_MAX_TOKENS; ++i) {
+            command->args[i] = i < line.count ? line.tokens[i].text : none;
         }
-        
-        person_t *person = (person_t *)const_person;
+        command->parsed = line.count > 0;
+        return true;
+    }
 
-        printFriendCount(person->handle, person->name, person->friend_count);
-        num_friendships --;
+    char input[1024];
+    if (fgets(input, sizeof(input), file) == NULL) {
+        return false;
+    }
 
-        return;
+    memset(command->text, 0, sizeof(command->text));
+    for (size_t i = 0; i < LOADER_MAX_TOKENS; ++i) {
+        command->args[i] = command->text[i];
+    }
+    command->parsed = sscanf(input, "%255s %255s %255s %255s", command->text[0], 
+            command->text[1], command->text[2], command->text[3]) >= 1;
+    return true;
+}
 
-    } if (strcmp(command, "stats") == 0) {
-        printf("Statistics: ");
-        printf("%d %s %d %s\n", num_accounts, num_accounts == 1 ? "person" : "people",num_friendships, 
-        num_friendships == 1 ? "friendship" : "friendships");
+/*
+*  (void orderBatchCommand(batch_command_t *command))
+*
+*  Works out what a command must wait for.  A command on one or two 
+*  people waits for the last earlier command on each of them, and adds 
+*  also wait for each other so people get their IDs in file order.  A 
+*  command that only reports a usage error waits for nothing.  Every 
+*  other command is a barrier.
+*  
+*  @param command: The command.
+*/
+void orderBatchCommand(batch_command_t *command) {
+    char **args = command->args;
 
+    command->barrier = false;
+    command->handle_count = 0;
+    command->next_count = 0;
+
+    if (!command->parsed) {
         return;
+    }
 
-    } if (strcmp(command, "init") == 0) {
+    if (strcmp(args[0], "add") == 0) {
+        if (args[1][0] != '\0' && args[2][0] != '\0' && args[3][0] != '\0') {
+            command->handles[command->handle_count++] = args[3];
+            command->handles[command->handle_count++] = "";    // the order of adds
+        }
+    } else if (strcmp(args[0], "print") == 0 || strcmp(args[0], "size") == 0) {
+        if (args[1][0] != '\0') {
+            command->handles[command->handle_count++] = args[1];
+        }
+    } else if (strcmp(args[0], "friend") == 0 || strcmp(args[0], "unfriend") == 0) {
+        if (args[1][0] != '\0' && args[2][0] != '\0') {
+            command->handles[command->handle_count++] = args[1];
+            if (strcmp(args[1], args[2]) != 0) {
+                command->handles[command->handle_count++] = args[2];
+            }
+        }
+    } else {
+        command->barrier = true;
+    }
+}
 
-        // ht_destroy(amici_table) - no need and I'm not completely sure why
-        // (Valgrind gives me errors when I try to destroy it)
+/*
+*  (void runBatchCommand(size_t index, void *arg))
+*
+*  Runs one command of a parallel batch on a pool thread, keeping its 
+*  output and errors until every command before it has shown theirs.
+*  
+*  @param index: The command's place in the group being run.
+*  @param arg: The batch, whose commands start at the group.
+*/
+void runBatchCommand(size_t index, void *arg) {
+    batch_t *batch = arg;
+    batch_command_t *command = &batch->commands[index];
 
-        num_accounts = 0;        
-        num_friendships = 0;
+    amici_out = open_memstream(&command->out, &command->out_length);
+    amici_err = open_memstream(&command->err, &command->err_length);
+    assert(amici_out != NULL && amici_err != NULL);
 
-        printf("System re-initialized\n");
+    fprintf(OUT, "\n");
 
-        return;
+    if (command->parsed) {
+        processLocked(batch->amici_table, command->args);
+    } else {
+        fprintf(ERR, "error: Unable to parse input\n");
+    }
 
-    } if (strcmp(command, "quit") == 0) {
-        printf("Exiting...\n");
+    fclose(amici_out);
+    fclose(amici_err);
+    amici_out = NULL;
+    amici_err = NULL;
+}
 
-        //ht_destroy(amici_table);
+/*
+*  (void runBatchGroup(batch_t *batch, Pool pool, size_t count))
+*
+*  Runs a group of commands with no barrier among them on the pool, each
+*  waiting for the commands it depends on, then shows their output in 
+*  file order.
+*  
+*  @param batch: The batch, whose commands start at the group.
+*  @param pool: The pool.
+*  @param count: The number of commands in the group.
+*/
+void runBatchGroup(batch_t *batch, Pool pool, size_t count) {
+    batch_command_t *commands = batch->commands;
+
+    for (size_t i = 0; i < count; ++i) {
+        batch->waits[i] = 0;
+
+        for (size_t h = 0; h < commands[i].handle_count; ++h) {
+            bool inserted;
+            HashSlot slot = ht_get_or_insert(batch->last, commands[i].handles[h], &inserted);
+            if (!inserted) {
+                batch_command_t *before = &commands[(uintptr_t)*slot.value - 1];
+                before->next[before->next_count++] = i;
+                batch->waits[i]++;
+            }
+            *slot.key = (void *)commands[i].handles[h];
+            *slot.value = (void *)(uintptr_t)(i + 1);
+        }
+    }
+    ht_clear(batch->last);
 
-        exit(EXIT_SUCCESS);
+    size_t edges = 0;
+    for (size_t i = 0; i < count; ++i) {
+        batch->next_start[i] = edges;
+        for (size_t e = 0; e < commands[i].next_count; ++e) {
+            batch->next[edges++] = commands[i].next[e];
+        }
     }
-    else {
+    batch->next_start[count] = edges;
 
-        fprintf(stderr, "error: command not recognized\n");
+    pool_run(pool, count, batch->waits, batch->next_start, batch->next, runBatchCommand, batch);
 
-        return;
+    for (size_t i = 0; i < count; ++i) {
+        fwrite(commands[i].out, 1, commands[i].out_length, stdout);
+        fwrite(commands[i].err, 1, commands[i].err_length, stderr);
+        free(commands[i].out);
+        free(commands[i].err);
     }
+}
+
+/*
+*  (void runBatch(HashADT amici_table, Loader loader, FILE *file, size_t jobs))
+*
+*  Runs a data file on several threads with the output, errors and final
+*  network of running it line by line.  The file is read BATCH_WINDOW 
+*  lines at a time; each window is cut at its barriers, which run alone,
+*  and the groups between them run on a work-stealing pool.
+*  
+*  @param amici_table: The hash table storing the people in the social media system.
+*  @param loader: The mapped data file, or NULL.
+*  @param file: The data file's stream, used when loader is NULL.
+*  @param jobs: The number of threads.
+*/
+void runBatch(HashADT amici_table, Loader loader, FILE *file, size_t jobs) {
+    batch_t batch;
+    batch.amici_table = amici_table;
+    batch.commands = malloc(BATCH_WINDOW * sizeof(batch_command_t));
+    batch.waits = malloc(BATCH_WINDOW * sizeof(size_t));
+    batch.next_start = malloc((BATCH_WINDOW + 1) * sizeof(size_t));
+    batch.next = malloc(2 * BATCH_WINDOW * sizeof(size_t));
+    assert(batch.commands != NULL && batch.waits != NULL && batch.next_start != NULL && batch.next != NULL);
+
+    // the table neither owns nor prints its entries
+    batch.last = ht_create_with_capacity(hash, equals, print, NULL, 2 * BATCH_WINDOW);
+
+    Pool pool = pool_create(jobs);
+    startSharing(amici_table, jobs);
+
+    batch_command_t *window = batch.commands;
+    size_t count;
+
+    do {
+        count = 0;
+        while (count < BATCH_WINDOW && readBatchCommand(loader, file, &window[count])) {
+            orderBatchCommand(&window[count]);
+            count++;
+        }
+
+        size_t start = 0;
+        while (start < count) {
+            if (window[start].barrier) {
+                fprintf(OUT, "\n");
+                processCommand(amici_table, window[start].args[0], window[start].args[1], 
+                        window[start].args[2], window[start].args[3]);
+                start++;
+                continue;
+            }
 
+            size_t end = start;
+            while (end < count && !window[end].barrier) {
+                end++;
+            }
+
+            batch.commands = window + start;
+            runBatchGroup(&batch, pool, end - start);
+            batch.commands = window;
+            start = end;
+        }
+    } while (count == BATCH_WINDOW);
+
+    stopSharing(amici_table);
+    pool_destroy(pool);
+
+    ht_destroy(batch.last);
+    free(batch.commands);
+    free(batch.waits);
+    free(batch.next_start);
+    free(batch.next);
 }
 
 /*
@@ -429,49 +3011,116 @@ void processCommand(HashADT amici_table, char *command, char *arg1, char *arg2,
 */
 int main(int argc, char *argv[]) {
 
-    HashADT amici_table = ht_create(hash, equals, print, delete);
+    // the table does not free anything; people belong to amici_arena
+    HashADT amici_table = ht_create(hash, equals, print, NULL);
+    amici_arena = arena_create();
+    ht_set_engine(amici_table, HT_SWISS);
+    ht_set_shrink(amici_table, true);
+    ht_set_incremental(amici_table, MIGRATE_STEP);
+
+    // "-w logfile" makes every mutation durable in a write-ahead log,
+    // "-s socket" serves clients instead of reading commands from stdin, 
+    // and "--jobs N" runs the data file, or serves, on N threads
+    int first = 1;
+    const char *log_path = NULL;
+    const char *socket_path = NULL;
+    size_t jobs = 0;
+    bool valid = true;
+    while (first + 1 < argc) {
+        if (strcmp(argv[first], "-w") == 0) {
+            log_path = argv[first + 1];
+        } else if (strcmp(argv[first], "-s") == 0) {
+            socket_path = argv[first + 1];
+        } else if (strcmp(argv[first], "--jobs") == 0) {
+            char *end;
+            jobs = strtoul(argv[first + 1], &end, 10);
+            valid = argv[first + 1][0] != '-' && *end == '\0' && jobs > 0;
+        } else {
+            break;
+        }
+        first += 2;
+    }
 
-    if (argc < 1 || argc > 2) {
-        fprintf(stderr, "error: usage: %s [datafile]\n", argv[0]);
+    if (!valid || argc < first || argc > first + 1) {
+        fprintf(ERR, "error: usage: %s [-w logfile] [-s socket] [--jobs N] [datafile]\n", argv[0]);
         return EXIT_FAILURE;
     }
 
-    if (argc == 2) { // if data file is present in command line
-        FILE *file = fopen(argv[1], "r");
+    const char *datafile = argc == first + 1 ? argv[first] : NULL;
+
+    if (log_path != NULL) {
+        amici_wal = recoverLog(amici_table, log_path);
+    }
+
+    // a regular data file is mapped and split in place
+    Loader loader = datafile != NULL ? loader_open(datafile) : NULL;
+
+    if (loader != NULL) {
+
+        // pre-size the tables for every account the file will add
+        size_t adds = loader_count(loader, "add");
+        ht_reserve(amici_table, adds);
+        reservePeople(adds);
+
+        if (jobs > 1) {
+            runBatch(amici_table, loader, NULL, jobs);
+        } else {
+            LoaderLine line;
+
+            while (loader_next(loader, &line)) {
+                fprintf(OUT, "\n");
+                executeLine(amici_table, &line);
+            }
+        }
+
+        loader_close(loader);
+    } else if (datafile != NULL) { // if data file is present in command line
+        FILE *file = fopen(datafile, "r");
         if (file == NULL) {
             perror("error");
             return EXIT_FAILURE;
         }
 
-        char input[1024];
+        // pre-size the tables for every account the file will add
+        size_t adds = countAddCommands(file);
+        ht_reserve(amici_table, adds);
+        reservePeople(adds);
 
-        while (fgets(input, sizeof(input), file) != NULL) {
-            char command[256], arg1[256], arg2[256], arg3[256];
+        if (jobs > 1) {
+            runBatch(amici_table, NULL, file, jobs);
+        } else {
+            char input[1024];
 
+            while (fgets(input, sizeof(input), file) != NULL) {
+                char command[256], arg1[256], arg2[256], arg3[256];
 
-            printf("\n");
 
-            memset(command, 0, sizeof(command)); // use of memset so there is no need to free
-            memset(arg1, 0, sizeof(arg1));       // these values
-            memset(arg2, 0, sizeof(arg2));
-            memset(arg3, 0, sizeof(arg3));
+                fprintf(OUT, "\n");
 
-            if (sscanf(input, "%255s %255s %255s %255s", command, arg1, arg2, arg3) >= 1) { // buffer overflow
-                processCommand(amici_table, command, arg1, arg2, arg3);
+                memset(command, 0, sizeof(command)); // use of memset so there is no need to free
+                memset(arg1, 0, sizeof(arg1));       // these values
+                memset(arg2, 0, sizeof(arg2));
+                memset(arg3, 0, sizeof(arg3));
+
+                if (sscanf(input, "%255s %255s %255s %255s", command, arg1, arg2, arg3) >= 1) { // buffer overflow
+                    processCommand(amici_table, command, arg1, arg2, arg3);
        
-            } else {
-                fprintf(stderr, "error: Unable to parse input\n");
+                } else {
+                    fprintf(ERR, "error: Unable to parse input\n");
+                }
             }
         }
 
         fclose(file);
-    } else {
+    } else if (socket_path == NULL) {
         // process commands from the user input
         char input[1024];
 
-        printf("Amici> ");
+        fprintf(OUT, "Amici> ");
 
-        while (fgets(input, sizeof(input), stdin) != NULL) {
+        // nothing the user has been told about may wait for a sync while
+        // amici waits for them
+        while ((amici_wal == NULL || wal_commit(amici_wal)) && fgets(input, sizeof(input), stdin) != NULL) {
             char command[256], arg1[256], arg2[256], arg3[256];
 
             memset(command, 0, sizeof(command));
@@ -484,12 +3133,26 @@ int main(int argc, char *argv[]) {
                 processCommand(amici_table, command, arg1, arg2, arg3);
               
             } else {
-                fprintf(stderr, "error: Unable to parse input\n");
+                fprintf(ERR, "error: Unable to parse input\n");
             }
 
-            printf("Amici> ");
+            fprintf(OUT, "Amici> ");
+        }
+    }
+
+    if (socket_path != NULL) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (jobs == 0) {
+            jobs = cpus > 0 ? (size_t)cpus : 1;
+        }
+
+        if (!serveClients(amici_table, socket_path, jobs)) {
+            wal_close(amici_wal);
+            return EXIT_FAILURE;
         }
     }
 
+    wal_close(amici_wal);
+
     return 0;
 }
@@ -0,0 +1,428 @@
+/*
+* File: cht_stress.c
+* Decription:
+* a stress test of ConcurrentHashADT that runs writers, readers and
+* racing inserters and removers at once and checks every result they
+* see against what a linearizable table could have returned
+*
+* Usage: cht_stress [rounds]
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "ConcurrentHashADT.h"
+
+#define WRITERS 4
+#define READERS 4
+#define RACERS 8
+#define KEYS_PER_WRITER 512
+#define KEYS (WRITERS * KEYS_PER_WRITER)
+#define RACE_KEYS 4096
+#define DEFAULT_ROUNDS 50
+#define OPS_PER_VISIT 8
+#define HOLD 1024
+
+#define LIVE 0x11fe11feu
+#define DEAD 0xdeaddeadu
+
+/*
+*  struct item_s:
+*  A value stored in the table
+*
+*  version is the number of the put that stored it.  magic is LIVE until
+*  the table releases the item, so a reader that finds anything else has
+*  read a released value.
+*/
+typedef struct item_s {
+    size_t key;
+    uint64_t version;
+    unsigned magic;
+} item;
+
+/*
+*  Each key of the history test is written by one writer only, which
+*  alternates puts and removes: its odd operations put the version of
+*  that number, its even ones remove the key.  started and done count
+*  the operations the writer has begun and finished on each key.
+*/
+static uint64_t started[KEYS];
+static uint64_t done[KEYS];
+
+// the key each writer is working on, which readers aim at
+static size_t current[WRITERS];
+
+static ConcurrentHashADT table;
+static size_t rounds = DEFAULT_ROUNDS;
+static bool writing = true;
+
+static size_t failures = 0;
+static size_t items = 0;            // items allocated and not yet released
+static size_t lookups = 0;
+
+// racers of one phase wait here for each other
+static pthread_barrier_t barrier;
+static size_t race_wins = 0;
+static size_t race_values[RACE_KEYS];
+
+
+/*
+*  static void fail(const char *what, size_t key, uint64_t got, uint64_t low, uint64_t high):
+*
+*  Reports a result no linearizable table could have returned.
+*/
+static void fail(const char *what, size_t key, uint64_t got, uint64_t low, uint64_t high){
+
+    if (__atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED) < 10) {
+        fprintf(stderr, "cht_stress: key %zu: %s (got %llu, allowed %llu..%llu)\n",
+                key, what, (unsigned long long)got, (unsigned long long)low,
+                (unsigned long long)high);
+    }
+}
+
+/*
+*  static size_t hash(const void *key):
+*
+*  Spreads neighbouring keys over the stripes and the slots.
+*/
+static size_t hash(const void *key){
+
+    uint64_t x = *(const size_t *)key;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+
+    return (size_t)x;
+}
+
+static bool equals(const void *key1, const void *key2){
+    return *(const size_t *)key1 == *(const size_t *)key2;
+}
+
+static void print(const void *key, const void *value){
+    printf("%zu: %llu", *(const size_t *)key, (unsigned long long)((const item *)value)->version);
+}
+
+/*
+*  static void delete(void *key, void *value):
+*
+*  Poisons the item before freeing it.  The key is NULL for a value
+*  handed to cht_retire_value().
+*/
+static void delete(void *key, void *value){
+
+    item *v = value;
+    if (v->magic != LIVE) {
+        fail("item released twice", v->key, v->magic, LIVE, LIVE);
+    }
+    v->magic = DEAD;
+    free(v);
+    free(key);
+    __atomic_sub_fetch(&items, 1, __ATOMIC_RELAXED);
+}
+
+/*
+*  static size_t *new_key(size_t key):
+*
+*  @return: Returns a key the table may own.
+*/
+static size_t *new_key(size_t key){
+
+    size_t *k = malloc(sizeof(size_t));
+    if (k == NULL) {
+        perror("cht_stress");
+        exit(EXIT_FAILURE);
+    }
+    *k = key;
+
+    return k;
+}
+
+/*
+*  static item *new_item(size_t key, uint64_t version):
+*
+*  @return: Returns a live item.
+*/
+static item *new_item(size_t key, uint64_t version){
+
+    item *v = malloc(sizeof(item));
+    if (v == NULL) {
+        perror("cht_stress");
+        exit(EXIT_FAILURE);
+    }
+    v->key = key;
+    v->version = version;
+    v->magic = LIVE;
+    __atomic_add_fetch(&items, 1, __ATOMIC_RELAXED);
+
+    return v;
+}
+
+/*
+*  static void *write_keys(void *arg):
+*
+*  A writer: visits each of its keys rounds times, alternately putting
+*  and removing it OPS_PER_VISIT times a visit.  Every other put
+*  replaces the value left by an earlier one instead of following a
+*  remove, so replaced values are retired too.
+*
+*  @param arg: The writer's number.
+*/
+static void *write_keys(void *arg){
+
+    size_t me = (size_t)(uintptr_t)arg;
+    size_t first = me * KEYS_PER_WRITER;
+
+    for (size_t round = 0; round < rounds; ++round) {
+        for (size_t visit = 0; visit < KEYS_PER_WRITER * OPS_PER_VISIT; ++visit) {
+            size_t key = first + visit / OPS_PER_VISIT;
+            __atomic_store_n(&current[me], key, __ATOMIC_RELAXED);
+
+            uint64_t op = __atomic_add_fetch(&started[key], 1, __ATOMIC_SEQ_CST);
+
+            if (op % 2 == 1) {
+                size_t *k = new_key(key);
+                item *old = cht_put(table, k, new_item(key, op));
+                if (old != NULL) {
+                    fail("put found a removed key", key, old->version, 0, 0);
+                }
+            } else if (op % 4 == 0) {
+                void *k;
+                item *old = cht_remove(table, &key, &k);
+                if (old == NULL || old->version != op - 1) {
+                    fail("remove lost the last put", key, old != NULL ? old->version : 0, op - 1, op - 1);
+                } else {
+                    cht_retire(table, k, old);
+                }
+            } else {
+                // a replacement, which is the remove that is due and the
+                // next put as one step
+                op = __atomic_add_fetch(&started[key], 1, __ATOMIC_SEQ_CST);
+                size_t *k = new_key(key);
+                item *old = cht_put(table, k, new_item(key, op));
+                if (old == NULL || old->version != op - 2) {
+                    fail("put lost the last put", key, old != NULL ? old->version : 0, op - 2, op - 2);
+                } else {
+                    // the table kept the key it already had
+                    free(k);
+                    cht_retire_value(table, old);
+                }
+            }
+
+            __atomic_store_n(&done[key], op, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+*  static void *read_keys(void *arg):
+*
+*  A reader: looks up keys, half of them ones a writer is working on,
+*  until the writers finish.  Whatever it finds must be the result of
+*  an operation that finished before the lookup began or overlapped it,
+*  and must stay readable while the reader holds it.
+*
+*  @param arg: The reader's number, seeding its choice of keys.
+*/
+static void *read_keys(void *arg){
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL * ((uintptr_t)arg + 1);
+    size_t count = 0;
+
+    while (__atomic_load_n(&writing, __ATOMIC_ACQUIRE)) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        size_t key = seed % KEYS;
+        if (seed & (1ULL << 40)) {
+            key = __atomic_load_n(&current[key % WRITERS], __ATOMIC_RELAXED);
+        }
+
+        uint64_t low = __atomic_load_n(&done[key], __ATOMIC_SEQ_CST);
+
+        cht_enter();
+        item *v = cht_find(table, &key);
+        uint64_t high = __atomic_load_n(&started[key], __ATOMIC_SEQ_CST);
+
+        // hold on to the value while writers retire and release others
+        for (size_t i = 0; v != NULL && i < HOLD; ++i) {
+            if (__atomic_load_n(&v->magic, __ATOMIC_RELAXED) != LIVE) {
+                break;
+            }
+        }
+
+        if (v == NULL) {
+            // a key is absent after each even operation, and before the first
+            if (low % 2 == 1 && high == low) {
+                fail("lookup missed a present key", key, 0, low, high);
+            }
+        } else if (v->magic != LIVE) {
+            fail("lookup returned a released item", key, v->magic, LIVE, LIVE);
+        } else if (v->key != key || v->version % 2 == 0
+                || v->version < low || v->version > high) {
+            fail("lookup returned a value the key never had then", key, v->version, low, high);
+        }
+        cht_leave();
+
+        count++;
+    }
+
+    __atomic_add_fetch(&lookups, count, __ATOMIC_RELAXED);
+
+    return NULL;
+}
+
+/*
+*  static void *race(void *arg):
+*
+*  A racer: every racer inserts every race key with cht_put_if_absent(),
+*  and then every racer removes every race key.  Exactly one insert and
+*  one remove of each key may succeed.
+*
+*  @param arg: The racer's number.
+*/
+static void *race(void *arg){
+
+    size_t me = (size_t)(uintptr_t)arg;
+
+    pthread_barrier_wait(&barrier);
+
+    for (size_t i = 0; i < RACE_KEYS; ++i) {
+        size_t key = KEYS + (i + me * 7) % RACE_KEYS;
+        size_t *k = new_key(key);
+        item *v = new_item(key, me);
+        item *there = cht_put_if_absent(table, k, v);
+        if (there == NULL) {
+            __atomic_add_fetch(&race_wins, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&race_values[key - KEYS], me + 1, __ATOMIC_RELAXED);
+        } else {
+            free(k);
+            delete(NULL, v);
+        }
+    }
+
+    pthread_barrier_wait(&barrier);
+
+    if (me == 0) {
+        if (race_wins != RACE_KEYS) {
+            fail("inserts of absent keys won", 0, race_wins, RACE_KEYS, RACE_KEYS);
+        }
+        race_wins = 0;
+    }
+
+    pthread_barrier_wait(&barrier);
+
+    for (size_t i = 0; i < RACE_KEYS; ++i) {
+        size_t key = KEYS + (i + me * 13) % RACE_KEYS;
+        void *k;
+        item *v = cht_remove(table, &key, &k);
+        if (v != NULL) {
+            __atomic_add_fetch(&race_wins, 1, __ATOMIC_RELAXED);
+            if (v->version + 1 != race_values[key - KEYS]) {
+                fail("remove returned a value that lost its insert", key, v->version,
+                     race_values[key - KEYS] - 1, race_values[key - KEYS] - 1);
+            }
+            cht_retire(table, k, v);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+*  static void count_pair(void *key, void *value, void *arg):
+*
+*  Counts the pairs of a walk.
+*/
+static void count_pair(void *key, void *value, void *arg){
+
+    (void)key;
+    (void)value;
+    ++*(size_t *)arg;
+}
+
+/*
+*  int main(int argc, char *argv[]):
+*
+*  Runs the history test with the writers, readers and racers all at
+*  once, then checks the table's final contents and that every item
+*  was released exactly once.
+*
+*  @return: Returns EXIT_SUCCESS if no check failed.
+*/
+int main(int argc, char *argv[]){
+
+    if (argc == 2) {
+        rounds = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2 || rounds == 0) {
+        fprintf(stderr, "usage: cht_stress [rounds]\n");
+        return EXIT_FAILURE;
+    }
+
+    // start small, so the test rehashes under load
+    table = cht_create(hash, equals, print, delete, 0);
+    pthread_barrier_init(&barrier, NULL, RACERS);
+
+    pthread_t writers[WRITERS], readers[READERS], racers[RACERS];
+    for (size_t i = 0; i < READERS; ++i) {
+        pthread_create(&readers[i], NULL, read_keys, (void *)(uintptr_t)i);
+    }
+    for (size_t i = 0; i < RACERS; ++i) {
+        pthread_create(&racers[i], NULL, race, (void *)(uintptr_t)i);
+    }
+    for (size_t i = 0; i < WRITERS; ++i) {
+        pthread_create(&writers[i], NULL, write_keys, (void *)(uintptr_t)i);
+    }
+
+    for (size_t i = 0; i < WRITERS; ++i) {
+        pthread_join(writers[i], NULL);
+    }
+    for (size_t i = 0; i < RACERS; ++i) {
+        pthread_join(racers[i], NULL);
+    }
+    __atomic_store_n(&writing, false, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < READERS; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+
+    if (race_wins != RACE_KEYS) {
+        fail("removes of present keys won", 0, race_wins, RACE_KEYS, RACE_KEYS);
+    }
+
+    // a key ends present if its writer's last operation was a put
+    size_t present = 0;
+    for (size_t key = 0; key < KEYS; ++key) {
+        bool there = done[key] % 2 == 1;
+        present += there;
+        if (cht_has(table, &key) != there) {
+            fail("key in the wrong state at the end", key, cht_has(table, &key), there, there);
+        }
+    }
+
+    size_t walked = 0;
+    cht_foreach(table, count_pair, &walked);
+    if (cht_size(table) != present || walked != present) {
+        fail("size disagrees with the keys present", 0, cht_size(table), present, walked);
+    }
+
+    cht_dump(table, false);
+    cht_destroy(table);
+    pthread_barrier_destroy(&barrier);
+
+    if (items != 0) {
+        fail("items were never released", 0, items, 0, 0);
+    }
+
+    printf("%zu lookups, %zu failures\n", lookups, failures);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,270 @@
+/*
+* File: graph_bench.c
+* Decription:
+* checks graph_intersect against a reference merge, then times it
+* against that merge and against scanning one list for every entry of
+* the other, on pairs of lists of similar and of very different lengths
+*
+* Usage: graph_bench [pairs]
+*
+* Author: Connor Patterson
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "Graph.h"
+
+#define DEFAULT_PAIRS 20000
+#define MAX_LENGTH 100000
+#define BENCH_NS 20000000       // how long each measurement runs at least
+
+static uint64_t seed = 0x2545f4914f6cdd1dULL;
+static volatile size_t sink;    // keeps the timed calls from being optimized out
+
+
+/*
+*  static uint64_t next(void):
+*
+*  @return: Returns the next number of a xorshift generator.
+*/
+static uint64_t next(void){
+
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    return seed;
+}
+
+/*
+*  static uint32_t *random_list(size_t count, uint32_t gap):
+*
+*  @param count: The length of the list.
+*  @param gap: The mean distance between neighbouring entries.
+*  @return: Returns a list of count distinct vertices in ascending
+*  order, spaced 1 to 2 * gap - 1 apart.
+*/
+static uint32_t *random_list(size_t count, uint32_t gap){
+
+    uint32_t *list = malloc((count + 1) * sizeof(uint32_t));
+    if (list == NULL) {
+        perror("graph_bench");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t x = (uint32_t)(next() % gap);
+    for (size_t i = 0; i < count; ++i) {
+        list[i] = x;
+        x += 1 + (uint32_t)(next() % (2 * gap - 1));
+    }
+
+    return list;
+}
+
+/*
+*  static size_t reference(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count, uint32_t *out):
+*
+*  The plain merge graph_intersect must agree with.
+*/
+static size_t reference(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count,
+        uint32_t *out){
+
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a_count && j < b_count) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            out[count++] = a[i];
+            i++;
+            j++;
+        }
+    }
+
+    return count;
+}
+
+/*
+*  static size_t scan(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count, uint32_t *out):
+*
+*  The naive intersection: looks for every entry of a in the whole of b.
+*/
+static size_t scan(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count,
+        uint32_t *out){
+
+    size_t count = 0;
+    for (size_t i = 0; i < a_count; ++i) {
+        for (size_t j = 0; j < b_count; ++j) {
+            if (a[i] == b[j]) {
+                out[count++] = a[i];
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+/*
+*  static size_t check(size_t a_count, uint32_t a_gap, size_t b_count, uint32_t b_gap):
+*
+*  Intersects one random pair both ways round, listing and counting,
+*  and compares each result with the reference merge.
+*
+*  @return: Returns the number of results that differed.
+*/
+static size_t check(size_t a_count, uint32_t a_gap, size_t b_count, uint32_t b_gap){
+
+    uint32_t *a = random_list(a_count, a_gap);
+    uint32_t *b = random_list(b_count, b_gap);
+    size_t shorter = a_count < b_count ? a_count : b_count;
+    uint32_t *want = malloc((shorter + 1) * sizeof(uint32_t));
+    uint32_t *got = malloc((shorter + 1) * sizeof(uint32_t));
+    if (want == NULL || got == NULL) {
+        perror("graph_bench");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t expected = reference(a, a_count, b, b_count, want);
+    size_t wrong = 0;
+
+    for (int swap = 0; swap < 2; ++swap) {
+        size_t count = swap ? graph_intersect(b, b_count, a, a_count, got)
+                            : graph_intersect(a, a_count, b, b_count, got);
+        size_t counted = swap ? graph_intersect(b, b_count, a, a_count, NULL)
+                              : graph_intersect(a, a_count, b, b_count, NULL);
+
+        bool same = count == expected && counted == expected;
+        for (size_t i = 0; same && i < expected; ++i) {
+            same = got[i] == want[i];
+        }
+        if (!same) {
+            if (wrong == 0) {
+                fprintf(stderr, "graph_bench: %zu x %zu: got %zu listed and %zu counted, want %zu\n",
+                        swap ? b_count : a_count, swap ? a_count : b_count,
+                        count, counted, expected);
+            }
+            wrong++;
+        }
+    }
+
+    free(a);
+    free(b);
+    free(want);
+    free(got);
+
+    return wrong;
+}
+
+/*
+*  static double time_us(size_t (*intersect)(...), const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count, uint32_t *out):
+*
+*  @return: Returns the mean time of one intersection, in microseconds,
+*  over as many as fit in BENCH_NS.
+*/
+static double time_us(size_t (*intersect)(const uint32_t *a, size_t a_count,
+                                          const uint32_t *b, size_t b_count, uint32_t *out),
+        const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count, uint32_t *out){
+
+    struct timespec start;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t runs = 0;
+    double elapsed;
+    do {
+        sink = intersect(a, a_count, b, b_count, out);
+        runs++;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (double)(now.tv_sec - start.tv_sec) * 1e9 + (double)(now.tv_nsec - start.tv_nsec);
+    } while (elapsed < BENCH_NS);
+
+    return elapsed / 1000 / runs;
+}
+
+/*
+*  int main(int argc, char *argv[]):
+*
+*  Checks pairs of every short length against each other, then random
+*  pairs with lengths spread over MAX_LENGTH, then times the pairs in
+*  the table below.
+*
+*  @return: Returns EXIT_SUCCESS if every result agreed with the reference.
+*/
+int main(int argc, char *argv[]){
+
+    size_t pairs = DEFAULT_PAIRS;
+    if (argc == 2) {
+        pairs = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2 || pairs == 0) {
+        fprintf(stderr, "usage: graph_bench [pairs]\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t wrong = 0;
+    size_t checked = 0;
+
+    // every pair of short lengths, around each kernel's block size
+    for (size_t a_count = 0; a_count <= 40; ++a_count) {
+        for (size_t b_count = 0; b_count <= 40; ++b_count) {
+            wrong += check(a_count, 2, b_count, 2);
+            checked++;
+        }
+    }
+
+    // lengths spread evenly over their logarithm, so skewed pairs on
+    // both sides of GRAPH_GALLOP_RATIO are common
+    for (size_t i = 0; i < pairs; ++i) {
+        size_t a_count = (size_t)(next() % MAX_LENGTH) >> (next() % 17);
+        size_t b_count = (size_t)(next() % MAX_LENGTH) >> (next() % 17);
+        uint32_t gap = 1 + (uint32_t)(next() % 4);
+        wrong += check(a_count, gap, b_count, gap);
+
+        // a short list spanning a long one's range
+        size_t longer = a_count > b_count ? a_count : b_count;
+        size_t ratio = 1 + next() % 200;
+        wrong += check(longer, gap, longer / ratio, gap * (uint32_t)ratio);
+        checked += 2;
+    }
+
+    printf("%zu pairs checked against the reference merge, %zu wrong\n", checked, wrong);
+
+    static const size_t bench[][2] = {
+        { 20, 20 }, { 1000, 1000 }, { 10000, 10000 }, { 1000, 20000 },
+        { 100, 3200 }, { 20, 88000 }, { 500, 88000 },
+    };
+
+    printf("%15s %14s %14s %14s\n", "friends", "intersect", "merge", "scan");
+    for (size_t i = 0; i < sizeof(bench) / sizeof(bench[0]); ++i) {
+        size_t a_count = bench[i][0];
+        size_t b_count = bench[i][1];
+
+        // both lists cover the same range, as two people's friends do
+        uint32_t *b = random_list(b_count, 4);
+        uint32_t *a = random_list(a_count, (uint32_t)(4 * b_count / a_count));
+        uint32_t *out = malloc(a_count * sizeof(uint32_t));
+        if (out == NULL) {
+            perror("graph_bench");
+            exit(EXIT_FAILURE);
+        }
+
+        printf("%6zu x %6zu %11.2f us %11.2f us %11.2f us\n", a_count, b_count,
+               time_us(graph_intersect, a, a_count, b, b_count, out),
+               time_us(reference, a, a_count, b, b_count, out),
+               time_us(scan, a, a_count, b, b_count, out));
+
+        free(a);
+        free(b);
+        free(out);
+    }
+
+    return wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
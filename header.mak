@@ -40,10 +40,10 @@ CFLAGS = -ggdb -std=c99 -Wall -Wextra -pedantic $(OPTS)
 #
 # This version links your code against the precompiled HashADT library
 #
-CLIBFLAGS = -L/home/course/csci243/pub/projects/02 -lhash -lm 
+# CLIBFLAGS = -L/home/course/csci243/pub/projects/02 -lhash -lm 
 
 #
 # This version doesn't use the precompiled HashADT library; instead,
 # your implementation will be used.
 #
-# CLIBFLAGS = -lm
+CLIBFLAGS = -lm -lpthread